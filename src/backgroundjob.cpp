@@ -0,0 +1,67 @@
+/*
+ * HexEditor -- Qt based hex editor
+ * Copyright (C) 2021  Mate Kukri
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "backgroundjob.h"
+#include <QtConcurrent>
+
+// How often the progress dialog is updated
+static int POLL_INTERVAL = 100;
+
+BackgroundJob::BackgroundJob(QString label, qint64 total, QWidget *parent)
+    : QObject(parent),
+      progress_dialog(label, "Cancel", 0, 1000, parent),
+      total(std::max<qint64>(total, 1)),
+      cancel(false),
+      progress(0)
+{
+    progress_dialog.setWindowModality(Qt::ApplicationModal);
+    progress_dialog.setMinimumDuration(0);
+    progress_dialog.setAutoReset(false);
+    progress_dialog.setAutoClose(false);
+    poll_timer.setInterval(POLL_INTERVAL);
+
+    // Connect event handlers, the dialog must stay up until the work stops
+    QObject::disconnect(&progress_dialog, SIGNAL(canceled()), &progress_dialog, SLOT(cancel()));
+    QObject::connect(&progress_dialog, SIGNAL(canceled()), this, SLOT(handleCanceled()));
+    QObject::connect(&poll_timer, SIGNAL(timeout()), this, SLOT(handlePoll()));
+    QObject::connect(&watcher, SIGNAL(finished()), &loop, SLOT(quit()));
+}
+
+bool BackgroundJob::run(const Work &work)
+{
+    progress_dialog.setValue(0);
+    progress_dialog.show();
+    poll_timer.start();
+    watcher.setFuture(QtConcurrent::run([this, &work]() { work(cancel, progress); }));
+    loop.exec();
+    poll_timer.stop();
+    progress_dialog.hide();
+    return !cancel;
+}
+
+void BackgroundJob::handlePoll()
+{
+    progress_dialog.setValue(static_cast<int>(std::min<qint64>(progress, total) * 1000 / total));
+}
+
+void BackgroundJob::handleCanceled()
+{
+    // The work notices on its own, the dialog stays up until it has
+    progress_dialog.setLabelText("Cancelling...");
+    cancel = true;
+}
@@ -0,0 +1,63 @@
+/*
+ * HexEditor -- Qt based hex editor
+ * Copyright (C) 2021  Mate Kukri
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef BACKGROUNDJOB_H
+#define BACKGROUNDJOB_H
+
+#include <QEventLoop>
+#include <QFutureWatcher>
+#include <QProgressDialog>
+#include <QTimer>
+#include <atomic>
+#include <functional>
+
+//
+// Long running work done off the GUI thread
+//
+// A modal progress dialog is up for the whole run, so the user can't edit,
+// close tabs or start another job until the work finishes or is cancelled.
+//
+class BackgroundJob : public QObject
+{
+    Q_OBJECT
+
+public:
+    // Work is told to stop through cancel and adds what it did to progress
+    typedef std::function<void(const std::atomic<bool> &cancel, std::atomic<qint64> &progress)> Work;
+
+    BackgroundJob(QString label, qint64 total, QWidget *parent);
+
+    // Run work to completion, returns false if the user cancelled it
+    bool run(const Work &work);
+
+private:
+    QProgressDialog progress_dialog;
+    QFutureWatcher<void> watcher;
+    QTimer poll_timer;
+    QEventLoop loop;
+
+    qint64 total;
+    std::atomic<bool> cancel;
+    std::atomic<qint64> progress;
+
+private slots:
+    void handlePoll();
+    void handleCanceled();
+};
+
+#endif // BACKGROUNDJOB_H
@@ -0,0 +1,189 @@
+/*
+ * HexEditor -- Qt based hex editor
+ * Copyright (C) 2021  Mate Kukri
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "bytesource.h"
+#include "compressedsource.h"
+#include <QCryptographicHash>
+#include <QDir>
+#include <QFileInfo>
+#include <QStandardPaths>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <limits>
+#include <sys/stat.h>
+#include <unistd.h>
+
+QByteArray ByteSource::read(qint64 offset, qint64 len)
+{
+    if (offset < 0 || len <= 0 || len > std::numeric_limits<int>::max())
+        return QByteArray();
+
+    QByteArray bytes(static_cast<int>(len), 0);
+    qint64 cnt = read(offset, bytes.data(), len);
+    bytes.resize(static_cast<int>(cnt < 0 ? 0 : cnt));
+    return bytes;
+}
+
+QVector<ByteRange> ByteSource::mappedRanges(qint64 begin, qint64 end)
+{
+    QVector<ByteRange> ranges;
+    begin = std::max<qint64>(begin, 0);
+    end = std::min(end, size());
+    if (begin < end) {
+        ranges.append({ begin, end });
+    }
+    return ranges;
+}
+
+QVector<ByteRange> ByteSource::searchRanges(QByteArray, qint64 begin, qint64 end)
+{
+    return mappedRanges(begin, end);
+}
+
+enum class Compression { None, Gzip, Xz, Zstd };
+
+// Format of the compressed image starting with magic
+static Compression compressionOf(QByteArray magic)
+{
+    if (magic.startsWith("\x1f\x8b"))
+        return Compression::Gzip;
+    if (magic.startsWith(QByteArray("\xfd" "7zXZ\x00", 6)))
+        return Compression::Xz;
+#ifdef HAVE_ZSTD
+    if (magic.startsWith("\x28\xb5\x2f\xfd"))
+        return Compression::Zstd;
+#endif
+    return Compression::None;
+}
+
+bool ByteSource::isCompressed(QByteArray magic)
+{
+    return compressionOf(magic) != Compression::None;
+}
+
+std::shared_ptr<ByteSource> ByteSource::open(QString fileName)
+{
+    // Sniff the magic to see if this is a compressed image
+    QFile probe(fileName);
+    probe.open(QFile::ReadOnly);
+    if (probe.error() != QFile::FileError::NoError) {
+        throw probe.errorString();
+    }
+    QByteArray magic = probe.read(6);
+    probe.close();
+
+    switch (compressionOf(magic)) {
+    case Compression::Gzip:
+        return std::make_shared<GzipByteSource>(fileName);
+    case Compression::Xz:
+        return std::make_shared<XzByteSource>(fileName);
+#ifdef HAVE_ZSTD
+    case Compression::Zstd:
+        return std::make_shared<ZstdByteSource>(fileName);
+#endif
+    default:
+        return std::make_shared<FileByteSource>(fileName);
+    }
+}
+
+QString ByteSource::sidecarPath(QString fileName, QString suffix)
+{
+    // Prefer keeping the sidecar next to the file
+    QFileInfo info(fileName);
+    if (QFileInfo(info.absolutePath()).isWritable()) {
+        return info.absoluteFilePath() + suffix;
+    }
+
+    // Otherwise fall back to the per-user cache directory
+    QDir cache_dir(QStandardPaths::writableLocation(QStandardPaths::CacheLocation));
+    cache_dir.mkpath(".");
+    auto hash = QCryptographicHash::hash(info.absoluteFilePath().toUtf8(),
+                                         QCryptographicHash::Sha1);
+    return cache_dir.filePath(QString::fromLatin1(hash.toHex()) + suffix);
+}
+
+FileByteSource::FileByteSource(QString fileName)
+    : file(fileName)
+{
+    file.open(QFile::ReadOnly);
+    if (file.error() != QFile::FileError::NoError) {
+        throw file.errorString();
+    }
+}
+
+FileByteSource::~FileByteSource()
+{
+    file.close();
+}
+
+qint64 FileByteSource::size()
+{
+    return file.size();
+}
+
+QString FileByteSource::fileName()
+{
+    return file.fileName();
+}
+
+bool FileByteSource::fileReplaced()
+{
+    // Compare the file we have open with whatever the path leads to now
+    struct stat open_st, path_st;
+    if (fstat(file.handle(), &open_st) < 0)
+        return false;
+    if (stat(QFile::encodeName(file.fileName()).constData(), &path_st) < 0)
+        return true;
+    return open_st.st_dev != path_st.st_dev || open_st.st_ino != path_st.st_ino;
+}
+
+qint64 FileByteSource::read(qint64 offset, char *buf, qint64 len)
+{
+    // pread has no shared file position, so readers don't need a lock
+    qint64 done = 0;
+    while (done < len) {
+        ssize_t cnt = pread(file.handle(), buf + done, len - done, offset + done);
+        if (cnt < 0 && errno == EINTR)
+            continue;
+        if (cnt <= 0)
+            break;
+        done += cnt;
+    }
+    return done;
+}
+
+MemoryByteSource::MemoryByteSource(QByteArray bytes)
+    : bytes(bytes)
+{
+}
+
+qint64 MemoryByteSource::size()
+{
+    return bytes.size();
+}
+
+qint64 MemoryByteSource::read(qint64 offset, char *buf, qint64 len)
+{
+    if (offset < 0 || offset >= bytes.size())
+        return 0;
+
+    qint64 cnt = std::min(len, bytes.size() - offset);
+    memcpy(buf, bytes.constData() + offset, cnt);
+    return cnt;
+}
@@ -0,0 +1,140 @@
+/*
+ * HexEditor -- Qt based hex editor
+ * Copyright (C) 2021  Mate Kukri
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef BYTESOURCE_H
+#define BYTESOURCE_H
+
+#include <QObject>
+#include <QByteArray>
+#include <QFile>
+#include <QString>
+#include <QVector>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+//
+// Half-open range of offsets
+//
+struct ByteRange
+{
+    qint64 begin, end;
+};
+
+//
+// Random access view of the bytes displayed by a HexWidget
+//
+// Sources are read from both the GUI thread and from background workers,
+// so implementations must make read() thread safe.
+//
+class ByteSource : public QObject
+{
+    Q_OBJECT
+
+public:
+    ~ByteSource() override {}
+
+    // Number of bytes currently readable from the source
+    virtual qint64 size() = 0;
+
+    // Read up to len bytes at offset into buf, returns the number of bytes read
+    virtual qint64 read(qint64 offset, char *buf, qint64 len) = 0;
+
+    // Convenience wrapper around read() returning a QByteArray, ranges too
+    // large for a QByteArray are refused with a null array rather than cut
+    QByteArray read(qint64 offset, qint64 len);
+
+    // Ranges of offsets inside [begin, end) that actually have data behind
+    // them, sparse sources read zeroes everywhere else
+    virtual QVector<ByteRange> mappedRanges(qint64 begin, qint64 end);
+
+    // Ranges inside [begin, end) that may contain matches of pattern, every
+    // range extends far enough to hold the matches starting in it
+    virtual QVector<ByteRange> searchRanges(QByteArray pattern, qint64 begin, qint64 end);
+
+    // Path of the file backing the source if it can be saved in place
+    virtual QString fileName() { return QString(); }
+
+    // Can the contents change while the source is open?
+    virtual bool isVolatile() { return false; }
+
+    // Was the file at fileName() renamed over or deleted since the source
+    // opened it? The source keeps reading the old file if so.
+    virtual bool fileReplaced() { return false; }
+
+    // Bytes of the contents held in memory by the source itself
+    virtual qint64 residentSize() { return 0; }
+
+    // Sources a view of other sources reads from, memory is held by them
+    virtual std::vector<ByteSource*> innerSources() { return {}; }
+
+    // Open the file at fileName with the source matching its contents
+    static std::shared_ptr<ByteSource> open(QString fileName);
+
+    // Does a file starting with magic open as a compressed image?
+    static bool isCompressed(QByteArray magic);
+
+    // Path of the sidecar file used to persist data derived from fileName
+    static QString sidecarPath(QString fileName, QString suffix);
+
+signals:
+    // Emitted (possibly from a background thread) when size() grows
+    void sizeChanged();
+};
+
+//
+// Plain uncompressed file on disk
+//
+class FileByteSource : public ByteSource
+{
+    Q_OBJECT
+
+public:
+    explicit FileByteSource(QString fileName);
+    ~FileByteSource() override;
+
+    using ByteSource::read;
+    qint64 size() override;
+    qint64 read(qint64 offset, char *buf, qint64 len) override;
+    QString fileName() override;
+    bool fileReplaced() override;
+
+private:
+    QFile file;
+};
+
+//
+// Immutable bytes held in memory
+//
+class MemoryByteSource : public ByteSource
+{
+    Q_OBJECT
+
+public:
+    explicit MemoryByteSource(QByteArray bytes);
+
+    using ByteSource::read;
+    qint64 size() override;
+    qint64 read(qint64 offset, char *buf, qint64 len) override;
+    qint64 residentSize() override { return bytes.size(); }
+
+private:
+    const QByteArray bytes;
+};
+
+#endif // BYTESOURCE_H
@@ -0,0 +1,181 @@
+/*
+ * HexEditor -- Qt based hex editor
+ * Copyright (C) 2021  Mate Kukri
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "clipboard.h"
+#include <QApplication>
+#include <QClipboard>
+
+// Largest selection offered to other applications
+static qint64 EXPORT_LIMIT = 64 * 1024 * 1024;
+
+// Size of the buffers materialized pieces are split into
+static qint64 MATERIALIZE_CHUNK = 64 * 1024 * 1024;
+
+ClipboardMimeData::ClipboardMimeData(std::shared_ptr<const PieceTable> table)
+    : table(table)
+{
+}
+
+QStringList ClipboardMimeData::formats() const
+{
+    if (table->size() > EXPORT_LIMIT)
+        return QStringList();
+    return { "application/octet-stream", "text/plain" };
+}
+
+QVariant ClipboardMimeData::retrieveData(const QString &mimetype, QVariant::Type type) const
+{
+    if (table->size() > EXPORT_LIMIT)
+        return QVariant();
+
+    QByteArray bytes(static_cast<int>(table->size()), 0);
+    bytes.resize(static_cast<int>(table->read(0, bytes.data(), bytes.size())));
+
+    if (mimetype == "application/octet-stream")
+        return bytes;
+    if (mimetype == "text/plain")
+        return QString(bytes.toHex(' ').toUpper());
+    return QMimeData::retrieveData(mimetype, type);
+}
+
+Clipboard::Clipboard(QObject *parent)
+    : QObject(parent),
+      held_bytes(0)
+{
+    QObject::connect(&watcher, SIGNAL(fileChanged(QString)), this, SLOT(handleFileChanged(QString)));
+    QObject::connect(qApp->clipboard(), SIGNAL(dataChanged()), this, SLOT(handleSystemClipboardChanged()));
+    MemoryGovernor::instance().add(this);
+}
+
+Clipboard::~Clipboard()
+{
+    MemoryGovernor::instance().remove(this);
+}
+
+void Clipboard::copy(Document &document, qint64 begin, qint64 end)
+{
+    table = std::make_shared<PieceTable>(document.snapshot()->slice(begin, end));
+
+    // Live memory has to be captured as it is right now
+    materialize([](ByteSource &source) { return source.isVolatile(); });
+
+    // Watch every file the pieces still refer to
+    if (!watcher.files().isEmpty()) {
+        watcher.removePaths(watcher.files());
+    }
+    QStringList paths;
+    table->forEach(0, table->size(), [&paths](qint64, const Piece &piece) {
+        QString path = piece.source->fileName();
+        if (!path.isEmpty() && !paths.contains(path)) {
+            paths.append(path);
+        }
+        return true;
+    });
+    if (!paths.isEmpty()) {
+        watcher.addPaths(paths);
+    }
+
+    publish();
+}
+
+std::shared_ptr<const PieceTable> Clipboard::contents()
+{
+    return table;
+}
+
+void Clipboard::materialize(const std::function<bool(ByteSource &)> &pred)
+{
+    auto new_table = std::make_shared<PieceTable>();
+    table->forEach(0, table->size(), [&](qint64, const Piece &piece) {
+        if (!pred(*piece.source)) {
+            new_table->append(piece);
+            return true;
+        }
+
+        for (qint64 pos = 0; pos < piece.length; pos += MATERIALIZE_CHUNK) {
+            qint64 cnt = std::min(MATERIALIZE_CHUNK, piece.length - pos);
+            QByteArray bytes(static_cast<int>(cnt), 0);
+            // Anything that can't be read anymore is left as zeroes
+            piece.source->read(piece.offset + pos, bytes.data(), cnt);
+            new_table->append({ std::make_shared<MemoryByteSource>(bytes), 0, cnt });
+        }
+        return true;
+    });
+    table = new_table;
+    updateHeldBytes();
+}
+
+void Clipboard::publish()
+{
+    qApp->clipboard()->setMimeData(new ClipboardMimeData(table));
+}
+
+void Clipboard::clear()
+{
+    table.reset();
+    held_bytes = 0;
+    if (!watcher.files().isEmpty()) {
+        watcher.removePaths(watcher.files());
+    }
+}
+
+void Clipboard::updateHeldBytes()
+{
+    qint64 bytes = 0;
+    table->forEachSource([&bytes](ByteSource *source) {
+        bytes += source->residentSize();
+    });
+    held_bytes = bytes;
+}
+
+void Clipboard::handleFileChanged(const QString &path)
+{
+    if (!table)
+        return;
+
+    // Files replaced by renaming a new copy over them (QSaveFile, most
+    // editors) are still readable in full through our open handle
+    bool replaced = true;
+    table->forEach(0, table->size(), [&](qint64, const Piece &piece) {
+        if (piece.source->fileName() == path && !piece.source->fileReplaced()) {
+            replaced = false;
+            return false;
+        }
+        return true;
+    });
+    if (replaced) {
+        watcher.removePath(path);
+        return;
+    }
+
+    // Modified in place, the copied bytes are already gone
+    bool owned = qApp->clipboard()->ownsClipboard();
+    clear();
+    if (owned) {
+        qApp->clipboard()->clear();
+    }
+    emit invalidated(path);
+}
+
+void Clipboard::handleSystemClipboardChanged()
+{
+    // Another application took over the clipboard
+    if (!qApp->clipboard()->ownsClipboard()) {
+        clear();
+    }
+}
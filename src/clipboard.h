@@ -0,0 +1,111 @@
+/*
+ * HexEditor -- Qt based hex editor
+ * Copyright (C) 2021  Mate Kukri
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef CLIPBOARD_H
+#define CLIPBOARD_H
+
+#include <QFileSystemWatcher>
+#include <QMimeData>
+#include <QObject>
+#include <QStringList>
+#include <QVariant>
+#include <atomic>
+#include <functional>
+#include "document.h"
+#include "memorygovernor.h"
+
+//
+// Clipboard contents as offered to other applications
+//
+// Nothing is read until another application actually asks for the data.
+//
+class ClipboardMimeData : public QMimeData
+{
+    Q_OBJECT
+
+public:
+    explicit ClipboardMimeData(std::shared_ptr<const PieceTable> table);
+
+    QStringList formats() const override;
+
+protected:
+    QVariant retrieveData(const QString &mimetype, QVariant::Type type) const override;
+
+private:
+    std::shared_ptr<const PieceTable> table;
+};
+
+//
+// Clipboard shared by every editor tab
+//
+// Copies only record which pieces of which sources were selected, so moving
+// data between tabs costs the same no matter how large the selection is.
+// The referenced sources are pinned by the pieces and documents never
+// modify their pieces, so later edits can't affect the clipboard. Live
+// process memory is read into memory right away. Files replaced on disk
+// (renamed over, like our own saves do) are still read through the old
+// handle, while files modified in place clear the clipboard, as reading
+// a large selection back in time is impossible anyway.
+//
+class Clipboard : public QObject, public MemoryConsumer
+{
+    Q_OBJECT
+
+public:
+    explicit Clipboard(QObject *parent = nullptr);
+    ~Clipboard() override;
+
+    // Copy [begin, end) of document
+    void copy(Document &document, qint64 begin, qint64 end);
+
+    // Data copied from one of our tabs, nullptr if the system clipboard
+    // holds data from somewhere else
+    std::shared_ptr<const PieceTable> contents();
+
+    // Buffers the contents refer to, only dropped by the user, so they
+    // don't count against the budget
+    QString memoryOwner() override { return tr("Clipboard"); }
+    QString memoryKind() override { return tr("Copied data"); }
+    qint64 memoryUsage() override { return held_bytes; }
+
+signals:
+    // The clipboard was cleared because path was modified in place
+    void invalidated(QString path);
+
+private:
+    std::shared_ptr<const PieceTable> table;
+    QFileSystemWatcher watcher;
+    std::atomic<qint64> held_bytes;
+
+    // Replace the pieces matching pred with in-memory copies
+    void materialize(const std::function<bool(ByteSource &)> &pred);
+
+    // Hand the current contents to the system clipboard
+    void publish();
+
+    // Drop the contents and stop watching their files
+    void clear();
+
+    void updateHeldBytes();
+
+private slots:
+    void handleFileChanged(const QString &path);
+    void handleSystemClipboardChanged();
+};
+
+#endif // CLIPBOARD_H
@@ -0,0 +1,861 @@
+/*
+ * HexEditor -- Qt based hex editor
+ * Copyright (C) 2021  Mate Kukri
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "compressedsource.h"
+#include <QDataStream>
+#include <QDateTime>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <zlib.h>
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+// Size of the decompressed windows kept in the cache
+static qint64 WINDOW_SIZE = 64 * 1024;
+// Minimum distance between checkpoints in the decompressed stream
+static qint64 SPAN = 4 * 1024 * 1024;
+// Size of reads from the compressed file
+static int CHUNK = 64 * 1024;
+// Size of the deflate history window
+static int WINSIZE = 32768;
+
+// Sidecar index file format
+static QString SIDECAR_SUFFIX(".hexidx");
+static quint32 INDEX_MAGIC = 0x48584931;
+static quint32 INDEX_VERSION = 1;
+
+CompressedByteSource::CompressedByteSource(QString fileName)
+    : file_name(fileName),
+      known_size(0),
+      complete(false),
+      cancel_index(false),
+      cache_bytes(0)
+{
+    auto file = std::make_unique<QFile>(fileName);
+    file->open(QFile::ReadOnly);
+    if (file->error() != QFile::FileError::NoError) {
+        throw file->errorString();
+    }
+    struct stat st;
+    file_fd = fcntl(file->handle(), F_DUPFD_CLOEXEC, 0);
+    if (file_fd < 0 || fstat(file_fd, &st) < 0) {
+        if (file_fd >= 0) {
+            close(file_fd);
+        }
+        throw QString(strerror(errno));
+    }
+    file_dev = st.st_dev;
+    file_ino = st.st_ino;
+    handles.push_back(std::move(file));
+    MemoryGovernor::instance().add(this);
+}
+
+CompressedByteSource::~CompressedByteSource()
+{
+    MemoryGovernor::instance().remove(this);
+    stopIndexing();
+    close(file_fd);
+}
+
+qint64 CompressedByteSource::size()
+{
+    return known_size;
+}
+
+bool CompressedByteSource::indexComplete()
+{
+    return complete;
+}
+
+qint64 CompressedByteSource::seekSpan()
+{
+    std::lock_guard<std::mutex> guard(index_lock);
+    qint64 span = 0;
+    for (int i = 0; i < checkpoints.size(); ++i) {
+        qint64 next = i + 1 < checkpoints.size() ? checkpoints[i + 1].out_offset : known_size.load();
+        span = std::max(span, next - checkpoints[i].out_offset);
+    }
+    return span;
+}
+
+qint64 CompressedByteSource::read(qint64 offset, char *buf, qint64 len)
+{
+    qint64 avail = known_size;
+    if (offset < 0 || offset >= avail)
+        return 0;
+    if (len > avail - offset)
+        len = avail - offset;
+
+    qint64 cached = cache_bytes;
+    qint64 done = 0;
+    while (done < len) {
+        qint64 pos = offset + done;
+        QByteArray win = window(pos / WINDOW_SIZE);
+        qint64 win_offs = pos % WINDOW_SIZE;
+        if (win_offs >= win.size())
+            break;
+
+        qint64 cnt = std::min(len - done, win.size() - win_offs);
+        memcpy(buf + done, win.constData() + win_offs, cnt);
+        done += cnt;
+    }
+
+    // No locks may be held while the governor evicts
+    if (cache_bytes > cached) {
+        MemoryGovernor::instance().charge();
+    }
+    return done;
+}
+
+void CompressedByteSource::startIndexing()
+{
+    if (persistIndex() && loadIndex()) {
+        complete = true;
+        return;
+    }
+    indexer = std::thread(&CompressedByteSource::runIndexer, this);
+}
+
+void CompressedByteSource::stopIndexing()
+{
+    cancel_index = true;
+    if (indexer.joinable()) {
+        indexer.join();
+    }
+}
+
+void CompressedByteSource::addCheckpoint(Checkpoint cp)
+{
+    std::lock_guard<std::mutex> guard(index_lock);
+    checkpoints.append(cp);
+}
+
+void CompressedByteSource::reportProgress(qint64 out_size)
+{
+    if (out_size > known_size) {
+        known_size = out_size;
+        emit sizeChanged();
+    }
+}
+
+void CompressedByteSource::runIndexer()
+{
+    // The indexer gets its own handle so it never contends with readers
+    auto in = openHandle();
+    if (!in)
+        return;
+
+    buildIndex(*in);
+    if (cancel_index)
+        return;
+
+    complete = true;
+    if (persistIndex()) {
+        saveIndex();
+    }
+    emit sizeChanged();
+    emit indexed();
+}
+
+bool CompressedByteSource::loadIndex()
+{
+    QFile sidecar(sidecarPath(file_name, SIDECAR_SUFFIX));
+    if (!sidecar.open(QFile::ReadOnly))
+        return false;
+
+    QDataStream stream(&sidecar);
+    quint32 magic, version;
+    qint64 file_size, file_mtime, total;
+    qint32 count;
+    stream >> magic >> version >> file_size >> file_mtime >> total >> count;
+
+    // The index is only valid for the exact file it was built from
+    QFileInfo info(file_name);
+    if (stream.status() != QDataStream::Ok
+            || magic != INDEX_MAGIC
+            || version != INDEX_VERSION
+            || file_size != info.size()
+            || file_mtime != info.lastModified().toMSecsSinceEpoch()
+            || count <= 0)
+        return false;
+
+    QVector<Checkpoint> loaded;
+    loaded.reserve(count);
+    for (qint32 i = 0; i < count; ++i) {
+        Checkpoint cp;
+        qint32 bits;
+        stream >> cp.in_offset >> cp.out_offset >> bits >> cp.window;
+        cp.bits = bits;
+        loaded.append(cp);
+    }
+    if (stream.status() != QDataStream::Ok)
+        return false;
+
+    std::lock_guard<std::mutex> guard(index_lock);
+    checkpoints = loaded;
+    known_size = total;
+    return true;
+}
+
+void CompressedByteSource::saveIndex()
+{
+    QVector<Checkpoint> saved;
+    {
+        std::lock_guard<std::mutex> guard(index_lock);
+        saved = checkpoints;
+    }
+
+    QSaveFile sidecar(sidecarPath(file_name, SIDECAR_SUFFIX));
+    if (!sidecar.open(QFile::WriteOnly))
+        return;
+
+    QFileInfo info(file_name);
+    QDataStream stream(&sidecar);
+    stream << INDEX_MAGIC << INDEX_VERSION
+           << static_cast<qint64>(info.size())
+           << static_cast<qint64>(info.lastModified().toMSecsSinceEpoch())
+           << static_cast<qint64>(known_size)
+           << static_cast<qint32>(saved.size());
+    for (auto &cp : saved) {
+        stream << cp.in_offset << cp.out_offset << static_cast<qint32>(cp.bits) << cp.window;
+    }
+    sidecar.commit();
+}
+
+std::unique_ptr<QFile> CompressedByteSource::takeHandle()
+{
+    {
+        std::lock_guard<std::mutex> guard(handles_lock);
+        if (!handles.empty()) {
+            auto handle = std::move(handles.back());
+            handles.pop_back();
+            return handle;
+        }
+    }
+
+    return openHandle();
+}
+
+std::unique_ptr<QFile> CompressedByteSource::openHandle()
+{
+    // The checkpoints describe the file we opened, not whatever a save may
+    // have put at its path since, so reopen that through our descriptor
+    auto handle = std::make_unique<QFile>(QString("/proc/self/fd/%1").arg(file_fd));
+    if (!handle->open(QFile::ReadOnly)) {
+        handle = std::make_unique<QFile>(file_name);
+        if (!handle->open(QFile::ReadOnly))
+            return nullptr;
+    }
+
+    struct stat st;
+    if (fstat(handle->handle(), &st) < 0 || st.st_dev != file_dev || st.st_ino != file_ino)
+        return nullptr;
+    return handle;
+}
+
+void CompressedByteSource::returnHandle(std::unique_ptr<QFile> handle)
+{
+    std::lock_guard<std::mutex> guard(handles_lock);
+    handles.push_back(std::move(handle));
+}
+
+QByteArray CompressedByteSource::cachedWindow(qint64 idx)
+{
+    auto it = cache.find(idx);
+    if (it == cache.end())
+        return QByteArray();
+    lru.splice(lru.begin(), lru, it->second.second);
+    touch();
+    return it->second.first;
+}
+
+QByteArray CompressedByteSource::window(qint64 idx)
+{
+    {
+        std::lock_guard<std::mutex> guard(cache_lock);
+        QByteArray cached = cachedWindow(idx);
+        if (!cached.isNull())
+            return cached;
+    }
+
+    // Find the closest checkpoint before the window
+    qint64 start = idx * WINDOW_SIZE;
+    Checkpoint cp;
+    {
+        std::lock_guard<std::mutex> guard(index_lock);
+        auto it = std::upper_bound(checkpoints.begin(), checkpoints.end(), start,
+            [](qint64 val, const Checkpoint &cp) { return val < cp.out_offset; });
+        if (it == checkpoints.begin())
+            return QByteArray();
+        cp = *(it - 1);
+    }
+
+    // Wait for anybody decompressing the same stretch, it might produce
+    // the window we need
+    {
+        std::unique_lock<std::mutex> guard(cache_lock);
+        while (decoding.count(cp.out_offset)) {
+            decoded.wait(guard);
+        }
+        QByteArray cached = cachedWindow(idx);
+        if (!cached.isNull())
+            return cached;
+        decoding.insert(cp.out_offset);
+    }
+
+    // Decompress up to the end of the window, caching every full window
+    // along the way as scrolling tends to revisit the neighbourhood
+    QByteArray cur, result;
+    qint64 pos = cp.out_offset;
+    auto handle = takeHandle();
+    if (handle) {
+        decompress(*handle, cp, [&](const char *data, qint64 len) {
+            while (len > 0) {
+                qint64 win_offs = pos % WINDOW_SIZE;
+                qint64 cnt = std::min(len, WINDOW_SIZE - win_offs);
+                if (win_offs == 0) {
+                    cur.clear();
+                }
+                // Windows are only collected from their first byte
+                if (cur.size() == win_offs) {
+                    cur.append(data, static_cast<int>(cnt));
+                }
+                pos += cnt;
+                data += cnt;
+                len -= cnt;
+
+                if (cur.size() == WINDOW_SIZE) {
+                    qint64 cur_idx = (pos - 1) / WINDOW_SIZE;
+                    cacheWindow(cur_idx, cur);
+                    if (cur_idx == idx) {
+                        result = cur;
+                        return false;
+                    }
+                    cur.clear();
+                }
+            }
+            return true;
+        });
+        returnHandle(std::move(handle));
+    }
+
+    // Partial window at the end of the stream
+    if (result.isNull() && pos > start && pos - start == cur.size()) {
+        result = cur;
+        if (complete && pos == known_size) {
+            cacheWindow(idx, cur);
+        }
+    }
+
+    {
+        std::lock_guard<std::mutex> guard(cache_lock);
+        decoding.erase(cp.out_offset);
+    }
+    decoded.notify_all();
+    return result;
+}
+
+void CompressedByteSource::cacheWindow(qint64 idx, QByteArray data)
+{
+    std::lock_guard<std::mutex> guard(cache_lock);
+    auto it = cache.find(idx);
+    if (it != cache.end()) {
+        lru.splice(lru.begin(), lru, it->second.second);
+        return;
+    }
+
+    lru.push_front(idx);
+    cache.emplace(idx, std::make_pair(data, lru.begin()));
+    cache_bytes += data.size();
+    touch();
+}
+
+qint64 CompressedByteSource::releaseMemory(qint64 bytes)
+{
+    std::lock_guard<std::mutex> guard(cache_lock);
+    qint64 freed = 0;
+    while (freed < bytes && !lru.empty()) {
+        auto it = cache.find(lru.back());
+        freed += it->second.first.size();
+        cache.erase(it);
+        lru.pop_back();
+    }
+    cache_bytes -= freed;
+    return freed;
+}
+
+int CompressedByteSource::reloadCost()
+{
+    // Getting a window back means decompressing up to a whole span
+    return 8;
+}
+
+GzipByteSource::GzipByteSource(QString fileName)
+    : CompressedByteSource(fileName)
+{
+    startIndexing();
+}
+
+GzipByteSource::~GzipByteSource()
+{
+    stopIndexing();
+}
+
+void GzipByteSource::buildIndex(QFile &in)
+{
+    z_stream strm;
+    memset(&strm, 0, sizeof strm);
+    if (inflateInit2(&strm, 47) != Z_OK)
+        return;
+
+    QByteArray input(CHUNK, 0);
+    QByteArray window(WINSIZE, 0);
+    auto refill = [&]() {
+        qint64 cnt = in.read(input.data(), CHUNK);
+        if (cnt <= 0)
+            return false;
+        strm.next_in = reinterpret_cast<Bytef*>(input.data());
+        strm.avail_in = static_cast<uInt>(cnt);
+        return true;
+    };
+
+    // The file starts with a gzip header
+    qint64 totin = 0, totout = 0, last = 0;
+    addCheckpoint({ 0, 0, -1, QByteArray() });
+
+    for (;;) {
+        if (indexCancelled())
+            break;
+        if (strm.avail_in == 0 && !refill())
+            break;
+
+        // Output wraps around in the history window
+        if (strm.avail_out == 0) {
+            strm.next_out = reinterpret_cast<Bytef*>(window.data());
+            strm.avail_out = WINSIZE;
+        }
+
+        totin += strm.avail_in;
+        totout += strm.avail_out;
+        int ret = inflate(&strm, Z_BLOCK);
+        totin -= strm.avail_in;
+        totout -= strm.avail_out;
+        if (ret == Z_NEED_DICT || ret == Z_DATA_ERROR || ret == Z_MEM_ERROR)
+            break;
+
+        if (ret == Z_STREAM_END) {
+            // Another gzip member might follow
+            if (strm.avail_in == 0 && !refill())
+                break;
+            if (*strm.next_in != 0x1f)
+                break;
+            inflateReset(&strm);
+            addCheckpoint({ totin, totout, -1, QByteArray() });
+            last = totout;
+            reportProgress(totout);
+            continue;
+        }
+
+        // Take a checkpoint at the start of a deflate block
+        if ((strm.data_type & 128) && !(strm.data_type & 64) && totout - last > SPAN) {
+            int pos = WINSIZE - static_cast<int>(strm.avail_out);
+            QByteArray history = window.mid(pos) + window.left(pos);
+            addCheckpoint({ totin, totout, strm.data_type & 7, qCompress(history) });
+            last = totout;
+            reportProgress(totout);
+        }
+    }
+
+    reportProgress(totout);
+    inflateEnd(&strm);
+}
+
+void GzipByteSource::decompress(QFile &in, const Checkpoint &cp, const Sink &sink)
+{
+    z_stream strm;
+    memset(&strm, 0, sizeof strm);
+
+    // Checkpoints inside a member resume a raw deflate stream
+    bool raw = cp.bits >= 0;
+    if (inflateInit2(&strm, raw ? -15 : 47) != Z_OK)
+        return;
+
+    if (!in.seek(cp.in_offset - (cp.bits > 0 ? 1 : 0))) {
+        inflateEnd(&strm);
+        return;
+    }
+    if (cp.bits > 0) {
+        char ch;
+        if (!in.getChar(&ch)) {
+            inflateEnd(&strm);
+            return;
+        }
+        inflatePrime(&strm, cp.bits, static_cast<unsigned char>(ch) >> (8 - cp.bits));
+    }
+    if (raw) {
+        QByteArray history = qUncompress(cp.window);
+        inflateSetDictionary(&strm, reinterpret_cast<const Bytef*>(history.constData()),
+                             static_cast<uInt>(history.size()));
+    }
+
+    QByteArray input(CHUNK, 0);
+    QByteArray output(CHUNK, 0);
+    auto refill = [&]() {
+        qint64 cnt = in.read(input.data(), CHUNK);
+        if (cnt <= 0)
+            return false;
+        strm.next_in = reinterpret_cast<Bytef*>(input.data());
+        strm.avail_in = static_cast<uInt>(cnt);
+        return true;
+    };
+
+    for (;;) {
+        if (strm.avail_in == 0 && !refill())
+            break;
+
+        strm.next_out = reinterpret_cast<Bytef*>(output.data());
+        strm.avail_out = CHUNK;
+        int ret = inflate(&strm, Z_NO_FLUSH);
+        if (ret == Z_NEED_DICT || ret == Z_DATA_ERROR || ret == Z_MEM_ERROR)
+            break;
+
+        qint64 have = CHUNK - strm.avail_out;
+        if (have > 0 && !sink(output.constData(), have))
+            break;
+
+        if (ret == Z_STREAM_END) {
+            // A raw stream leaves the member trailer for us to skip
+            if (raw) {
+                uInt skip = 8;
+                while (skip > 0) {
+                    if (strm.avail_in == 0 && !refill())
+                        break;
+                    uInt cnt = std::min(skip, strm.avail_in);
+                    strm.next_in += cnt;
+                    strm.avail_in -= cnt;
+                    skip -= cnt;
+                }
+                if (skip > 0)
+                    break;
+            }
+
+            // Continue with the next member, if any
+            if (strm.avail_in == 0 && !refill())
+                break;
+            if (*strm.next_in != 0x1f)
+                break;
+            inflateReset2(&strm, 47);
+            raw = false;
+        }
+    }
+
+    inflateEnd(&strm);
+}
+
+XzByteSource::XzByteSource(QString fileName)
+    : CompressedByteSource(fileName),
+      index(nullptr)
+{
+    startIndexing();
+}
+
+XzByteSource::~XzByteSource()
+{
+    stopIndexing();
+    if (index) {
+        lzma_index_end(index, nullptr);
+    }
+}
+
+void XzByteSource::buildIndex(QFile &in)
+{
+    // Walk the streams backwards from the end of the file, combining
+    // their indexes the same way `xz --list` does
+    lzma_index *combined = nullptr;
+    lzma_vli padding = 0;
+    qint64 pos = in.size();
+    uint8_t buf[LZMA_STREAM_HEADER_SIZE];
+    bool ok = true;
+
+    auto readAt = [&](qint64 offset, void *dest, qint64 len) {
+        return in.seek(offset) && in.read(reinterpret_cast<char*>(dest), len) == len;
+    };
+
+    while (ok && pos > 0) {
+        if (pos < 2 * LZMA_STREAM_HEADER_SIZE || !readAt(pos - 4, buf, 4)) {
+            ok = false;
+            break;
+        }
+
+        // Skip stream padding
+        if (buf[0] == 0 && buf[1] == 0 && buf[2] == 0 && buf[3] == 0) {
+            pos -= 4;
+            padding += 4;
+            continue;
+        }
+
+        lzma_stream_flags footer_flags;
+        pos -= LZMA_STREAM_HEADER_SIZE;
+        if (!readAt(pos, buf, LZMA_STREAM_HEADER_SIZE)
+                || lzma_stream_footer_decode(&footer_flags, buf) != LZMA_OK
+                || pos < static_cast<qint64>(footer_flags.backward_size) + LZMA_STREAM_HEADER_SIZE) {
+            ok = false;
+            break;
+        }
+
+        pos -= footer_flags.backward_size;
+        QByteArray raw_index(static_cast<int>(footer_flags.backward_size), 0);
+        lzma_index *this_index = nullptr;
+        uint64_t memlimit = UINT64_MAX;
+        size_t in_pos = 0;
+        if (!readAt(pos, raw_index.data(), raw_index.size())
+                || lzma_index_buffer_decode(&this_index, &memlimit, nullptr,
+                                            reinterpret_cast<const uint8_t*>(raw_index.constData()),
+                                            &in_pos, raw_index.size()) != LZMA_OK) {
+            ok = false;
+            break;
+        }
+
+        lzma_stream_flags header_flags;
+        qint64 blocks_size = static_cast<qint64>(lzma_index_total_size(this_index));
+        if (pos < blocks_size + LZMA_STREAM_HEADER_SIZE
+                || !readAt(pos - blocks_size - LZMA_STREAM_HEADER_SIZE, buf, LZMA_STREAM_HEADER_SIZE)
+                || lzma_stream_header_decode(&header_flags, buf) != LZMA_OK
+                || lzma_stream_flags_compare(&header_flags, &footer_flags) != LZMA_OK) {
+            lzma_index_end(this_index, nullptr);
+            ok = false;
+            break;
+        }
+        pos -= blocks_size + LZMA_STREAM_HEADER_SIZE;
+
+        if (lzma_index_stream_flags(this_index, &footer_flags) != LZMA_OK
+                || lzma_index_stream_padding(this_index, padding) != LZMA_OK
+                || (combined && lzma_index_cat(this_index, combined, nullptr) != LZMA_OK)) {
+            lzma_index_end(this_index, nullptr);
+            ok = false;
+            break;
+        }
+        padding = 0;
+        combined = this_index;
+    }
+
+    if (!ok || !combined) {
+        if (combined) {
+            lzma_index_end(combined, nullptr);
+        }
+        return;
+    }
+
+    // Publish the index before the checkpoints referring to it
+    index = combined;
+    lzma_index_iter iter;
+    lzma_index_iter_init(&iter, index);
+    while (!lzma_index_iter_next(&iter, LZMA_INDEX_ITER_NONEMPTY_BLOCK)) {
+        addCheckpoint({ static_cast<qint64>(iter.block.compressed_file_offset),
+                        static_cast<qint64>(iter.block.uncompressed_file_offset),
+                        -1, QByteArray() });
+    }
+    reportProgress(static_cast<qint64>(lzma_index_uncompressed_size(index)));
+}
+
+void XzByteSource::decompress(QFile &in, const Checkpoint &cp, const Sink &sink)
+{
+    lzma_index_iter iter;
+    lzma_index_iter_init(&iter, index);
+    if (lzma_index_iter_locate(&iter, cp.out_offset))
+        return;
+
+    do {
+        if (!decodeBlock(in, iter, sink))
+            return;
+    } while (!lzma_index_iter_next(&iter, LZMA_INDEX_ITER_NONEMPTY_BLOCK));
+}
+
+bool XzByteSource::decodeBlock(QFile &in, const lzma_index_iter &iter, const Sink &sink)
+{
+    uint8_t header[LZMA_BLOCK_HEADER_SIZE_MAX];
+    if (!in.seek(iter.block.compressed_file_offset)
+            || in.read(reinterpret_cast<char*>(header), 1) != 1)
+        return false;
+
+    lzma_filter filters[LZMA_FILTERS_MAX + 1];
+    lzma_block block;
+    memset(&block, 0, sizeof block);
+    block.version = 0;
+    block.check = iter.stream.flags->check;
+    block.filters = filters;
+    block.header_size = lzma_block_header_size_decode(header[0]);
+
+    qint64 rest = block.header_size - 1;
+    if (in.read(reinterpret_cast<char*>(header) + 1, rest) != rest
+            || lzma_block_header_decode(&block, nullptr, header) != LZMA_OK)
+        return false;
+
+    bool more = false;
+    lzma_stream strm = LZMA_STREAM_INIT;
+    if (lzma_block_compressed_size(&block, iter.block.unpadded_size) == LZMA_OK
+            && lzma_block_decoder(&strm, &block) == LZMA_OK) {
+        QByteArray input(CHUNK, 0);
+        QByteArray output(CHUNK, 0);
+        qint64 remaining = iter.block.total_size - block.header_size;
+
+        for (;;) {
+            if (strm.avail_in == 0 && remaining > 0) {
+                qint64 cnt = in.read(input.data(), std::min<qint64>(CHUNK, remaining));
+                if (cnt <= 0)
+                    break;
+                remaining -= cnt;
+                strm.next_in = reinterpret_cast<const uint8_t*>(input.constData());
+                strm.avail_in = static_cast<size_t>(cnt);
+            }
+
+            strm.next_out = reinterpret_cast<uint8_t*>(output.data());
+            strm.avail_out = CHUNK;
+            lzma_ret ret = lzma_code(&strm, LZMA_RUN);
+
+            qint64 have = CHUNK - static_cast<qint64>(strm.avail_out);
+            if (have > 0 && !sink(output.constData(), have))
+                break;
+            if (ret == LZMA_STREAM_END) {
+                more = true;
+                break;
+            }
+            if (ret != LZMA_OK || (have == 0 && strm.avail_in == 0 && remaining == 0))
+                break;
+        }
+    }
+
+    lzma_end(&strm);
+    for (int i = 0; filters[i].id != LZMA_VLI_UNKNOWN; ++i) {
+        free(filters[i].options);
+    }
+    return more;
+}
+
+#ifdef HAVE_ZSTD
+ZstdByteSource::ZstdByteSource(QString fileName)
+    : CompressedByteSource(fileName)
+{
+    startIndexing();
+}
+
+ZstdByteSource::~ZstdByteSource()
+{
+    stopIndexing();
+}
+
+void ZstdByteSource::buildIndex(QFile &in)
+{
+    ZSTD_DStream *dstream = ZSTD_createDStream();
+    if (!dstream)
+        return;
+
+    QByteArray input(CHUNK, 0);
+    QByteArray output(static_cast<int>(ZSTD_DStreamOutSize()), 0);
+    qint64 totin = 0, totout = 0, last = 0;
+    bool frame_start = true;
+    bool failed = false;
+
+    while (!failed && !indexCancelled()) {
+        qint64 cnt = in.read(input.data(), CHUNK);
+        if (cnt <= 0)
+            break;
+
+        ZSTD_inBuffer ib = { input.constData(), static_cast<size_t>(cnt), 0 };
+        while (ib.pos < ib.size) {
+            // Frames are independent, so every frame start can be a checkpoint
+            if (frame_start) {
+                qint64 frame_in = totin + static_cast<qint64>(ib.pos);
+                if (totout == 0 || totout - last > SPAN) {
+                    addCheckpoint({ frame_in, totout, -1, QByteArray() });
+                    last = totout;
+                    reportProgress(totout);
+                }
+                frame_start = false;
+            }
+
+            ZSTD_outBuffer ob = { output.data(), static_cast<size_t>(output.size()), 0 };
+            size_t ret = ZSTD_decompressStream(dstream, &ob, &ib);
+            if (ZSTD_isError(ret)) {
+                failed = true;
+                break;
+            }
+            totout += static_cast<qint64>(ob.pos);
+            if (ret == 0) {
+                frame_start = true;
+            }
+        }
+        totin += cnt;
+    }
+
+    // Flush whatever output is still buffered
+    if (!failed) {
+        ZSTD_inBuffer ib = { nullptr, 0, 0 };
+        for (;;) {
+            ZSTD_outBuffer ob = { output.data(), static_cast<size_t>(output.size()), 0 };
+            size_t ret = ZSTD_decompressStream(dstream, &ob, &ib);
+            if (ZSTD_isError(ret))
+                break;
+            totout += static_cast<qint64>(ob.pos);
+            if (ob.pos < ob.size)
+                break;
+        }
+    }
+
+    reportProgress(totout);
+    ZSTD_freeDStream(dstream);
+}
+
+void ZstdByteSource::decompress(QFile &in, const Checkpoint &cp, const Sink &sink)
+{
+    if (!in.seek(cp.in_offset))
+        return;
+
+    ZSTD_DStream *dstream = ZSTD_createDStream();
+    if (!dstream)
+        return;
+
+    QByteArray input(CHUNK, 0);
+    QByteArray output(static_cast<int>(ZSTD_DStreamOutSize()), 0);
+    bool done = false;
+
+    while (!done) {
+        qint64 cnt = in.read(input.data(), CHUNK);
+        ZSTD_inBuffer ib = { input.constData(), static_cast<size_t>(cnt > 0 ? cnt : 0), 0 };
+        do {
+            ZSTD_outBuffer ob = { output.data(), static_cast<size_t>(output.size()), 0 };
+            size_t ret = ZSTD_decompressStream(dstream, &ob, &ib);
+            if (ZSTD_isError(ret)
+                    || (ob.pos > 0 && !sink(output.constData(), static_cast<qint64>(ob.pos)))
+                    || (cnt <= 0 && ob.pos < ob.size)) {
+                done = true;
+                break;
+            }
+        } while (ib.pos < ib.size || cnt <= 0);
+    }
+
+    ZSTD_freeDStream(dstream);
+}
+#endif
@@ -0,0 +1,212 @@
+/*
+ * HexEditor -- Qt based hex editor
+ * Copyright (C) 2021  Mate Kukri
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef COMPRESSEDSOURCE_H
+#define COMPRESSEDSOURCE_H
+
+#include "bytesource.h"
+#include "memorygovernor.h"
+#include <QVector>
+#include <atomic>
+#include <condition_variable>
+#include <sys/types.h>
+#include <functional>
+#include <list>
+#include <set>
+#include <thread>
+#include <unordered_map>
+#include <lzma.h>
+
+//
+// Seekable view of a compressed image
+//
+// A checkpoint index of decompressor state is built on a background thread,
+// random access then decompresses from the closest checkpoint before the
+// requested offset. Decompressed windows are kept in an LRU cache whose size
+// is left to the memory governor.
+//
+class CompressedByteSource : public ByteSource, public MemoryConsumer
+{
+    Q_OBJECT
+
+public:
+    ~CompressedByteSource() override;
+
+    using ByteSource::read;
+    qint64 size() override;
+    qint64 read(qint64 offset, char *buf, qint64 len) override;
+
+    // Has the checkpoint index been fully built?
+    bool indexComplete();
+
+    // Most data decompressed to reach any offset, meaningful once indexed
+    qint64 seekSpan();
+
+    // Path of the compressed file
+    QString getPath() { return file_name; }
+
+    QString memoryOwner() override { return file_name; }
+    QString memoryKind() override { return tr("Decompressed data"); }
+    qint64 memoryUsage() override { return cache_bytes; }
+    qint64 releaseMemory(qint64 bytes) override;
+    int reloadCost() override;
+
+protected:
+    struct Checkpoint {
+        // Offset of the first compressed byte to feed the decompressor
+        qint64 in_offset;
+        // Offset of the first byte the decompressor produces
+        qint64 out_offset;
+        // Bits to prime the decompressor with from the byte before
+        // in_offset, or -1 if in_offset is the start of a stream
+        int bits;
+        // qCompress-ed decompressor history preceding out_offset
+        QByteArray window;
+    };
+
+    // Receives decompressed data, returns false once it has seen enough
+    typedef std::function<bool(const char *data, qint64 len)> Sink;
+
+    explicit CompressedByteSource(QString fileName);
+
+    // Load the persisted index, or start building it in the background,
+    // must be called at the end of the subclass constructor
+    void startIndexing();
+
+    // Stop the indexer, must be called from the subclass destructor
+    void stopIndexing();
+
+    // Build the checkpoint index (runs on the indexer thread)
+    virtual void buildIndex(QFile &in) = 0;
+
+    // Decompress from a checkpoint until the sink is satisfied or EOF
+    virtual void decompress(QFile &in, const Checkpoint &cp, const Sink &sink) = 0;
+
+    // Should the index be persisted into a sidecar file?
+    virtual bool persistIndex() { return true; }
+
+    // Helpers for buildIndex()
+    void addCheckpoint(Checkpoint cp);
+    void reportProgress(qint64 out_size);
+    bool indexCancelled() { return cancel_index; }
+
+    QString file_name;
+
+signals:
+    // Emitted (from the indexer thread) once the index is complete
+    void indexed();
+
+private:
+    // Idle handles of the compressed file, every decompression takes its
+    // own so readers never wait for each other
+    std::vector<std::unique_ptr<QFile>> handles;
+    std::mutex handles_lock;
+
+    // The file opened first, new handles must refer to the same one
+    int file_fd;
+    dev_t file_dev;
+    ino_t file_ino;
+
+    // Checkpoint index
+    QVector<Checkpoint> checkpoints;
+    std::mutex index_lock;
+    std::atomic<qint64> known_size;
+    std::atomic<bool> complete;
+    std::atomic<bool> cancel_index;
+    std::thread indexer;
+
+    // Cache of recently used decompressed windows
+    std::mutex cache_lock;
+    std::list<qint64> lru;
+    std::unordered_map<qint64, std::pair<QByteArray, std::list<qint64>::iterator>> cache;
+    std::atomic<qint64> cache_bytes;
+
+    // Checkpoints being decompressed from, readers needing the same
+    // stretch wait for the first one instead of repeating its work
+    std::set<qint64> decoding;
+    std::condition_variable decoded;
+
+    void runIndexer();
+    bool loadIndex();
+    void saveIndex();
+    QByteArray window(qint64 idx);
+    void cacheWindow(qint64 idx, QByteArray data);
+    QByteArray cachedWindow(qint64 idx);
+    std::unique_ptr<QFile> openHandle();
+    std::unique_ptr<QFile> takeHandle();
+    void returnHandle(std::unique_ptr<QFile> handle);
+};
+
+//
+// gzip image, checkpoints are taken at deflate block boundaries
+//
+class GzipByteSource : public CompressedByteSource
+{
+    Q_OBJECT
+
+public:
+    explicit GzipByteSource(QString fileName);
+    ~GzipByteSource() override;
+
+protected:
+    void buildIndex(QFile &in) override;
+    void decompress(QFile &in, const Checkpoint &cp, const Sink &sink) override;
+};
+
+//
+// xz image, checkpoints are the blocks listed in the stream indexes
+//
+class XzByteSource : public CompressedByteSource
+{
+    Q_OBJECT
+
+public:
+    explicit XzByteSource(QString fileName);
+    ~XzByteSource() override;
+
+protected:
+    void buildIndex(QFile &in) override;
+    void decompress(QFile &in, const Checkpoint &cp, const Sink &sink) override;
+    bool persistIndex() override { return false; }
+
+private:
+    lzma_index *index;
+
+    // Decode a single block, returns false once no more data is needed
+    static bool decodeBlock(QFile &in, const lzma_index_iter &iter, const Sink &sink);
+};
+
+#ifdef HAVE_ZSTD
+//
+// zstd image, checkpoints are frame boundaries
+//
+class ZstdByteSource : public CompressedByteSource
+{
+    Q_OBJECT
+
+public:
+    explicit ZstdByteSource(QString fileName);
+    ~ZstdByteSource() override;
+
+protected:
+    void buildIndex(QFile &in) override;
+    void decompress(QFile &in, const Checkpoint &cp, const Sink &sink) override;
+};
+#endif
+
+#endif // COMPRESSEDSOURCE_H
@@ -0,0 +1,676 @@
+/*
+ * HexEditor -- Qt based hex editor
+ * Copyright (C) 2021  Mate Kukri
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "document.h"
+#include "transformsource.h"
+#include <QSaveFile>
+#include <algorithm>
+#include <atomic>
+#include <unordered_set>
+
+// Size of the blocks written when saving
+static qint64 SAVE_CHUNK = 4 * 1024 * 1024;
+
+struct PieceTable::Node
+{
+    Piece piece;
+    NodePtr left, right;
+    // Bytes in the subtree
+    qint64 total;
+    quint32 priority;
+};
+
+// Pseudo-random treap priorities, safe to draw from any thread
+static quint32 nextPriority()
+{
+    static std::atomic<quint64> counter(0);
+    quint64 x = ++counter * 0x9e3779b97f4a7c15ull;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+    return static_cast<quint32>((x ^ (x >> 31)) >> 32);
+}
+
+PieceTable::NodePtr PieceTable::makeNode(const Piece &piece, NodePtr left, NodePtr right, quint32 priority)
+{
+    auto node = std::make_shared<Node>();
+    node->total = sizeOf(left) + piece.length + sizeOf(right);
+    node->piece = piece;
+    node->left = std::move(left);
+    node->right = std::move(right);
+    node->priority = priority;
+    return node;
+}
+
+qint64 PieceTable::sizeOf(const NodePtr &node)
+{
+    return node ? node->total : 0;
+}
+
+PieceTable::NodePtr PieceTable::join(NodePtr a, NodePtr b)
+{
+    if (!a)
+        return b;
+    if (!b)
+        return a;
+
+    if (a->priority > b->priority)
+        return makeNode(a->piece, a->left, join(a->right, b), a->priority);
+    return makeNode(b->piece, join(a, b->left), b->right, b->priority);
+}
+
+PieceTable::NodePtr PieceTable::splitPieces(const NodePtr &node, qint64 offset,
+                                            NodePtr &right, Piece &straddling, qint64 &in_piece)
+{
+    if (!node) {
+        right = nullptr;
+        return nullptr;
+    }
+
+    qint64 left_size = sizeOf(node->left);
+    const Piece &piece = node->piece;
+    if (offset <= left_size) {
+        NodePtr left = splitPieces(node->left, offset, right, straddling, in_piece);
+        right = makeNode(piece, right, node->right, node->priority);
+        return left;
+    }
+    if (offset >= left_size + piece.length) {
+        NodePtr left = splitPieces(node->right, offset - left_size - piece.length, right, straddling, in_piece);
+        return makeNode(piece, node->left, left, node->priority);
+    }
+
+    // Both sides of the piece are whole treaps already
+    straddling = piece;
+    in_piece = offset - left_size;
+    right = node->right;
+    return node->left;
+}
+
+std::pair<PieceTable::NodePtr, PieceTable::NodePtr> PieceTable::split(const NodePtr &node, qint64 offset)
+{
+    if (offset <= 0)
+        return { nullptr, node };
+    if (offset >= sizeOf(node))
+        return { node, nullptr };
+
+    NodePtr right;
+    Piece straddling = { nullptr, 0, 0 };
+    qint64 in_piece = 0;
+    NodePtr left = splitPieces(node, offset, right, straddling, in_piece);
+    if (!straddling.source)
+        return { left, right };
+
+    // The halves get fresh priorities, giving both the old one would chain
+    // fragments of the same piece together as it is cut up again and again
+    Piece head = { straddling.source, straddling.offset, in_piece };
+    Piece tail = { straddling.source, straddling.offset + in_piece, straddling.length - in_piece };
+    return { join(left, makeNode(head, nullptr, nullptr, nextPriority())),
+             join(makeNode(tail, nullptr, nullptr, nextPriority()), right) };
+}
+
+void PieceTable::append(const Piece &piece)
+{
+    if (piece.length <= 0)
+        return;
+
+    // Find the last piece, growing it instead copies the same path
+    const Node *last = root.get();
+    while (last && last->right) {
+        last = last->right.get();
+    }
+    if (last && last->piece.source == piece.source && last->piece.offset + last->piece.length == piece.offset) {
+        std::function<NodePtr(const NodePtr &)> grow = [&](const NodePtr &node) {
+            if (!node->right) {
+                Piece merged = node->piece;
+                merged.length += piece.length;
+                return makeNode(merged, node->left, nullptr, node->priority);
+            }
+            return makeNode(node->piece, node->left, grow(node->right), node->priority);
+        };
+        root = grow(root);
+        return;
+    }
+
+    root = join(root, makeNode(piece, nullptr, nullptr, nextPriority()));
+}
+
+qint64 PieceTable::size() const
+{
+    return sizeOf(root);
+}
+
+void PieceTable::forEachSource(const std::function<void(ByteSource *source)> &visit) const
+{
+    std::unordered_set<ByteSource*> seen;
+    std::function<void(ByteSource*)> add = [&](ByteSource *source) {
+        if (!seen.insert(source).second)
+            return;
+        visit(source);
+        for (ByteSource *inner : source->innerSources()) {
+            add(inner);
+        }
+    };
+    forEach(0, size(), [&](qint64, const Piece &piece) {
+        add(piece.source.get());
+        return true;
+    });
+}
+
+PieceTable PieceTable::slice(qint64 begin, qint64 end) const
+{
+    begin = std::max<qint64>(begin, 0);
+    end = std::min(end, size());
+    if (begin >= end)
+        return PieceTable();
+
+    return PieceTable(split(split(root, end).first, begin).second);
+}
+
+bool PieceTable::visitRange(const NodePtr &node, qint64 node_start, qint64 begin, qint64 end,
+                            const std::function<bool(qint64, const Piece &)> &visit)
+{
+    if (!node)
+        return true;
+
+    qint64 piece_start = node_start + sizeOf(node->left);
+    qint64 piece_end = piece_start + node->piece.length;
+    if (begin < piece_start && !visitRange(node->left, node_start, begin, end, visit))
+        return false;
+    if (piece_start < end && piece_end > begin && !visit(piece_start, node->piece))
+        return false;
+    if (end > piece_end)
+        return visitRange(node->right, piece_end, begin, end, visit);
+    return true;
+}
+
+void PieceTable::forEach(qint64 begin, qint64 end,
+                         const std::function<bool(qint64, const Piece &)> &visit) const
+{
+    visitRange(root, 0, begin, end, visit);
+}
+
+QVector<ByteRange> PieceTable::mappedRanges(qint64 begin, qint64 end) const
+{
+    begin = std::max<qint64>(begin, 0);
+    end = std::min(end, size());
+
+    // Translate the mapped ranges of every piece, merging neighbours
+    QVector<ByteRange> ranges;
+    forEach(begin, end, [&](qint64 piece_start, const Piece &piece) {
+        qint64 from = std::max(begin, piece_start) - piece_start + piece.offset;
+        qint64 to = std::min(end, piece_start + piece.length) - piece_start + piece.offset;
+        for (auto &range : piece.source->mappedRanges(from, to)) {
+            ByteRange doc_range = { range.begin - piece.offset + piece_start,
+                                    range.end - piece.offset + piece_start };
+            if (!ranges.isEmpty() && ranges.last().end == doc_range.begin) {
+                ranges.last().end = doc_range.end;
+            } else {
+                ranges.append(doc_range);
+            }
+        }
+        return true;
+    });
+    return ranges;
+}
+
+qint64 PieceTable::read(qint64 offset, char *buf, qint64 len) const
+{
+    if (offset < 0 || offset >= size())
+        return 0;
+    len = std::min(len, size() - offset);
+
+    qint64 done = 0;
+    forEach(offset, offset + len, [&](qint64 piece_start, const Piece &piece) {
+        qint64 in_piece = offset + done - piece_start;
+        qint64 cnt = std::min(len - done, piece.length - in_piece);
+        qint64 got = piece.source->read(piece.offset + in_piece, buf + done, cnt);
+        if (got != cnt)
+            return false;
+        done += cnt;
+        return true;
+    });
+    return done;
+}
+
+Replacement::Replacement(std::shared_ptr<const PieceTable> old, qint64 len, const PieceTable &with)
+    : old(old),
+      len(len),
+      with(with),
+      rest(*old),
+      pos(0),
+      replacements(0)
+{
+}
+
+void Replacement::add(qint64 offset)
+{
+    // Skip anything overlapping the previous replacement
+    if (offset < pos || offset > old->size())
+        return;
+
+    auto before = PieceTable::split(rest.root, offset - pos);
+    done.root = PieceTable::join(done.root, before.first);
+
+    // The same contents go in many times, fresh nodes keep the tree balanced
+    with.forEach(0, with.size(), [this](qint64, const Piece &piece) {
+        done.append(piece);
+        return true;
+    });
+
+    qint64 cut = std::min(len, old->size() - offset);
+    rest.root = PieceTable::split(before.second, cut).second;
+    pos = offset + cut;
+    ++replacements;
+}
+
+PieceTable Replacement::result() const
+{
+    return PieceTable(PieceTable::join(done.root, rest.root));
+}
+
+Document::Document(std::shared_ptr<ByteSource> base)
+    : base(base),
+      base_size(base->size()),
+      file_name(base->fileName()),
+      history_pos(0),
+      history_bytes(0)
+{
+    auto table = std::make_shared<PieceTable>();
+    table->append({ base, 0, base_size });
+    history.push_back(table);
+    history_sources.emplace_back();
+    saved = table;
+    addSources(*table);
+
+    // Picks up an index built in an earlier session
+    if (SearchIndex::canIndex(*base)) {
+        search_index = std::make_shared<SearchIndex>(base);
+    }
+
+    QObject::connect(base.get(), SIGNAL(sizeChanged()), this, SLOT(handleBaseGrowth()));
+    MemoryGovernor::instance().add(this);
+}
+
+Document::~Document()
+{
+    MemoryGovernor::instance().remove(this);
+}
+
+std::shared_ptr<const PieceTable> Document::snapshot()
+{
+    std::lock_guard<std::mutex> guard(history_lock);
+    return history[history_pos];
+}
+
+qint64 Document::size()
+{
+    return snapshot()->size();
+}
+
+QString Document::fileName()
+{
+    return file_name;
+}
+
+qint64 Document::read(qint64 offset, char *buf, qint64 len)
+{
+    return snapshot()->read(offset, buf, len);
+}
+
+QVector<ByteRange> Document::mappedRanges(qint64 begin, qint64 end)
+{
+    return snapshot()->mappedRanges(begin, end);
+}
+
+QVector<ByteRange> Document::searchRanges(QByteArray pattern, qint64 begin, qint64 end)
+{
+    auto table = snapshot();
+    begin = std::max<qint64>(begin, 0);
+    end = std::min(end, table->size());
+
+    // The index covers the file as it is on disk, edits are always scanned
+    QVector<ByteRange> candidates;
+    if (!search_index || !search_index->candidates(pattern, candidates))
+        return mappedRanges(begin, end);
+
+    QVector<ByteRange> ranges;
+    auto addRange = [&](qint64 from, qint64 to) {
+        from = std::max(from, begin);
+        to = std::min(to, end);
+        if (from < to) {
+            ranges.append({ from, to });
+        }
+    };
+
+    qint64 tail = pattern.size() - 1;
+    table->forEach(begin, end, [&](qint64 piece_start, const Piece &piece) {
+        qint64 piece_end = piece_start + piece.length;
+        if (piece.source != base) {
+            addRange(piece_start, piece_end);
+            return true;
+        }
+
+        // Candidate blocks overlapping the piece, matches may run into the
+        // next piece
+        auto it = std::upper_bound(candidates.begin(), candidates.end(), piece.offset,
+            [](qint64 val, const ByteRange &range) { return val < range.end; });
+        for (; it != candidates.end() && it->begin < piece.offset + piece.length; ++it) {
+            qint64 from = std::max(it->begin, piece.offset) - piece.offset + piece_start;
+            qint64 to = std::min(it->end, piece.offset + piece.length) - piece.offset + piece_start;
+            addRange(from, to + tail);
+        }
+
+        // Matches spanning the edges of the piece
+        if (piece_start > 0) {
+            addRange(piece_start - tail, piece_start + tail);
+        }
+        return true;
+    });
+
+    // Merge the ranges in offset order
+    std::sort(ranges.begin(), ranges.end(),
+        [](const ByteRange &a, const ByteRange &b) { return a.begin < b.begin; });
+    QVector<ByteRange> merged;
+    for (auto &range : ranges) {
+        if (!merged.isEmpty() && range.begin <= merged.last().end) {
+            merged.last().end = std::max(merged.last().end, range.end);
+        } else {
+            merged.append(range);
+        }
+    }
+    return merged;
+}
+
+void Document::replace(qint64 offset, qint64 len, const PieceTable &with)
+{
+    Replacement replacement(snapshot(), len, with);
+    replacement.add(offset);
+    replace(replacement);
+}
+
+void Document::replace(qint64 offset, qint64 len, QByteArray bytes)
+{
+    PieceTable with;
+    if (!bytes.isEmpty()) {
+        with.append({ std::make_shared<MemoryByteSource>(bytes), 0, bytes.size() });
+    }
+    replace(offset, len, with);
+}
+
+void Document::replace(const Replacement &replacement)
+{
+    if (replacement.count() == 0)
+        return;
+
+    // A compressed base may have grown since the replacements were made,
+    // growth only ever appends to the contents
+    auto table = std::make_shared<PieceTable>(replacement.result());
+    auto current = snapshot();
+    auto grown = current->slice(replacement.original()->size(), current->size());
+    grown.forEach(0, grown.size(), [&](qint64, const Piece &piece) {
+        table->append(piece);
+        return true;
+    });
+    pushTable(table, replacement.inserted());
+}
+
+void Document::transform(qint64 begin, qint64 end, const Transform &transform)
+{
+    auto old = snapshot();
+    begin = std::max<qint64>(begin, 0);
+    end = std::min(end, old->size());
+    if (begin >= end)
+        return;
+
+    // The range is replaced by a view of itself, nothing is copied
+    PieceTable with;
+    with.append({ std::make_shared<TransformByteSource>(old->slice(begin, end), transform), 0, end - begin });
+    replace(begin, end - begin, with);
+}
+
+void Document::addSources(const PieceTable &inserted)
+{
+    inserted.forEachSource([this](ByteSource *source) {
+        auto &entry_sources = history_sources.back();
+        if (std::find(entry_sources.begin(), entry_sources.end(), source) != entry_sources.end())
+            return;
+
+        entry_sources.push_back(source);
+        if (source_refs[source]++ == 0) {
+            history_bytes += source->residentSize();
+        }
+    });
+}
+
+void Document::dropLastEntry()
+{
+    for (ByteSource *source : history_sources.back()) {
+        if (--source_refs[source] == 0) {
+            source_refs.erase(source);
+            history_bytes -= source->residentSize();
+        }
+    }
+    history_sources.pop_back();
+    history.pop_back();
+}
+
+void Document::dropFirstEntry()
+{
+    // Sources still used by the next entry are now brought in by it
+    std::unordered_set<ByteSource*> kept;
+    auto &next_sources = history_sources[1];
+    history[1]->forEachSource([&kept](ByteSource *source) {
+        kept.insert(source);
+    });
+
+    for (ByteSource *source : history_sources.front()) {
+        if (kept.count(source)
+                && std::find(next_sources.begin(), next_sources.end(), source) == next_sources.end()) {
+            next_sources.push_back(source);
+        } else if (--source_refs[source] == 0) {
+            source_refs.erase(source);
+            history_bytes -= source->residentSize();
+        }
+    }
+
+    // The saved contents can't be returned to anymore
+    if (history.front() == saved) {
+        saved.reset();
+    }
+    history_sources.erase(history_sources.begin());
+    history.erase(history.begin());
+}
+
+void Document::pushTable(std::shared_ptr<const PieceTable> table, const PieceTable &inserted)
+{
+    bool grew;
+    {
+        std::lock_guard<std::mutex> guard(history_lock);
+        grew = table->size() > history[history_pos]->size();
+        while (history.size() > history_pos + 1) {
+            dropLastEntry();
+        }
+        history.push_back(table);
+        history_sources.emplace_back();
+        addSources(inserted);
+        ++history_pos;
+    }
+    touch();
+    if (grew) {
+        emit sizeChanged();
+    }
+    emit changed();
+
+    // The new buffers might push other documents' caches out
+    MemoryGovernor::instance().charge();
+}
+
+bool Document::canUndo()
+{
+    std::lock_guard<std::mutex> guard(history_lock);
+    return history_pos > 0;
+}
+
+bool Document::canRedo()
+{
+    std::lock_guard<std::mutex> guard(history_lock);
+    return history_pos + 1 < history.size();
+}
+
+void Document::undo()
+{
+    {
+        std::lock_guard<std::mutex> guard(history_lock);
+        if (history_pos == 0)
+            return;
+        --history_pos;
+    }
+    touch();
+    emit changed();
+}
+
+void Document::redo()
+{
+    {
+        std::lock_guard<std::mutex> guard(history_lock);
+        if (history_pos + 1 >= history.size())
+            return;
+        ++history_pos;
+    }
+    touch();
+    emit changed();
+}
+
+bool Document::modified()
+{
+    std::lock_guard<std::mutex> guard(history_lock);
+    return history[history_pos] != saved;
+}
+
+QString Document::memoryOwner()
+{
+    {
+        std::lock_guard<std::mutex> guard(history_lock);
+        if (!file_name.isEmpty())
+            return file_name;
+    }
+
+    // Sources that can't be saved in place still have a name for their cache
+    auto consumer = dynamic_cast<MemoryConsumer*>(base.get());
+    return consumer ? consumer->memoryOwner() : tr("Untitled");
+}
+
+qint64 Document::memoryUsage()
+{
+    std::lock_guard<std::mutex> guard(history_lock);
+    return history_bytes;
+}
+
+qint64 Document::releaseMemory(qint64 bytes)
+{
+    // Oldest undo steps go first, the current contents always stay, don't
+    // lose any undo steps if the current and redo entries need everything
+    std::lock_guard<std::mutex> guard(history_lock);
+    std::unordered_set<ByteSource*> needed;
+    qint64 needed_bytes = 0;
+    for (size_t idx = history_pos; idx < history.size(); ++idx) {
+        history[idx]->forEachSource([&](ByteSource *source) {
+            if (needed.insert(source).second) {
+                needed_bytes += source->residentSize();
+            }
+        });
+    }
+    if (needed_bytes >= history_bytes)
+        return 0;
+
+    qint64 before = history_bytes;
+    while (history_pos > 0 && before - history_bytes < bytes) {
+        dropFirstEntry();
+        --history_pos;
+    }
+    return before - history_bytes;
+}
+
+int Document::reloadCost()
+{
+    // Forgotten undo steps are gone for good
+    return 64;
+}
+
+void Document::handleBaseGrowth()
+{
+    qint64 new_size = base->size();
+    if (new_size <= base_size)
+        return;
+
+    // The part of the base that just appeared follows whatever the document
+    // contains at every point in history
+    Piece tail = { base, base_size, new_size - base_size };
+    {
+        std::lock_guard<std::mutex> guard(history_lock);
+        for (auto &entry : history) {
+            auto table = std::make_shared<PieceTable>(*entry);
+            table->append(tail);
+            if (entry == saved) {
+                saved = table;
+            }
+            entry = table;
+        }
+    }
+    base_size = new_size;
+    emit sizeChanged();
+}
+
+bool Document::save(QString fileName, const std::function<bool(qint64, qint64)> &progress)
+{
+    auto table = snapshot();
+
+    // The old file stays readable through our open handle after the
+    // replacement is renamed over it, so pieces referring to it stay valid
+    QSaveFile out(fileName);
+    if (!out.open(QFile::WriteOnly)) {
+        throw out.errorString();
+    }
+
+    QByteArray buf(static_cast<int>(SAVE_CHUNK), 0);
+    for (qint64 pos = 0; pos < table->size(); pos += SAVE_CHUNK) {
+        if (!progress(pos, table->size())) {
+            out.cancelWriting();
+            return false;
+        }
+
+        qint64 cnt = std::min(SAVE_CHUNK, table->size() - pos);
+        if (table->read(pos, buf.data(), cnt) != cnt) {
+            out.cancelWriting();
+            throw QString("Failed to read document contents!");
+        }
+        if (out.write(buf.constData(), cnt) != cnt) {
+            out.cancelWriting();
+            throw out.errorString();
+        }
+    }
+    progress(table->size(), table->size());
+
+    if (!out.commit()) {
+        throw out.errorString();
+    }
+
+    std::lock_guard<std::mutex> guard(history_lock);
+    saved = table;
+    file_name = fileName;
+    return true;
+}
@@ -0,0 +1,237 @@
+/*
+ * HexEditor -- Qt based hex editor
+ * Copyright (C) 2021  Mate Kukri
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef DOCUMENT_H
+#define DOCUMENT_H
+
+#include "bytesource.h"
+#include "memorygovernor.h"
+#include "searchindex.h"
+#include <functional>
+#include <unordered_map>
+#include <vector>
+
+struct Transform;
+
+//
+// Contiguous run of bytes taken from a source
+//
+struct Piece
+{
+    std::shared_ptr<ByteSource> source;
+    qint64 offset;
+    qint64 length;
+};
+
+//
+// Immutable snapshot of a document's contents
+//
+// The pieces are kept in a persistent balanced tree (a treap ordered by
+// position), an edit only creates the O(log n) nodes on its path and shares
+// everything else with the table it was made from.
+//
+class PieceTable
+{
+public:
+    PieceTable() {}
+
+    // Append a piece, merging it into the last one if they are contiguous
+    void append(const Piece &piece);
+
+    qint64 size() const;
+
+    // Read up to len bytes at offset, returns the number of bytes read
+    qint64 read(qint64 offset, char *buf, qint64 len) const;
+
+    // Pieces covering [begin, end)
+    PieceTable slice(qint64 begin, qint64 end) const;
+
+    // Mapped ranges of the pieces inside [begin, end)
+    QVector<ByteRange> mappedRanges(qint64 begin, qint64 end) const;
+
+    // Call visit with every piece overlapping [begin, end) and the offset
+    // it starts at, in order, until visit returns false
+    void forEach(qint64 begin, qint64 end,
+                 const std::function<bool(qint64 start, const Piece &piece)> &visit) const;
+
+    // Call visit once for every distinct source the pieces read from,
+    // including those underneath views of other sources
+    void forEachSource(const std::function<void(ByteSource *source)> &visit) const;
+
+private:
+    struct Node;
+    typedef std::shared_ptr<const Node> NodePtr;
+    NodePtr root;
+
+    explicit PieceTable(NodePtr root) : root(root) {}
+
+    static NodePtr makeNode(const Piece &piece, NodePtr left, NodePtr right, quint32 priority);
+    static qint64 sizeOf(const NodePtr &node);
+
+    // Concatenate two trees, every byte of a comes before b
+    static NodePtr join(NodePtr a, NodePtr b);
+
+    // Cut a tree into the bytes before offset and the rest
+    static std::pair<NodePtr, NodePtr> split(const NodePtr &node, qint64 offset);
+
+    // Cut a tree at the piece boundaries around offset, returns the pieces
+    // before it and sets right to the ones after, the piece offset falls
+    // inside of (if any) goes to straddling
+    static NodePtr splitPieces(const NodePtr &node, qint64 offset,
+                               NodePtr &right, Piece &straddling, qint64 &in_piece);
+
+    static bool visitRange(const NodePtr &node, qint64 node_start, qint64 begin, qint64 end,
+                           const std::function<bool(qint64, const Piece &)> &visit);
+
+    friend class Replacement;
+};
+
+//
+// Piece table with a run of replacements applied
+//
+// Offsets are added one at a time as a search finds them, so the matches
+// never have to be collected first. Every replacement costs O(log n).
+//
+class Replacement
+{
+public:
+    Replacement(std::shared_ptr<const PieceTable> old, qint64 len, const PieceTable &with);
+
+    // Replace len bytes at offset with the contents, offsets must increase
+    // and ones overlapping the previous replacement are skipped
+    void add(qint64 offset);
+
+    // Number of replacements made
+    qint64 count() const { return replacements; }
+
+    // Contents the replacements were made in
+    std::shared_ptr<const PieceTable> original() const { return old; }
+
+    // Contents put in place of every match
+    const PieceTable &inserted() const { return with; }
+
+    // The contents with every replacement applied
+    PieceTable result() const;
+
+private:
+    std::shared_ptr<const PieceTable> old;
+    qint64 len;
+    PieceTable with;
+
+    // New contents up to pos and the old contents from pos
+    PieceTable done, rest;
+    qint64 pos;
+    qint64 replacements;
+};
+
+//
+// Editable view of a ByteSource
+//
+// Edits never touch the underlying source, they produce a new piece table
+// referring to the source and to in-memory buffers holding the new bytes.
+// Every edit is one undo step, no matter how many places it changes.
+//
+class Document : public ByteSource, public MemoryConsumer
+{
+    Q_OBJECT
+
+public:
+    explicit Document(std::shared_ptr<ByteSource> base);
+    ~Document() override;
+
+    using ByteSource::read;
+    qint64 size() override;
+    qint64 read(qint64 offset, char *buf, qint64 len) override;
+    QVector<ByteRange> mappedRanges(qint64 begin, qint64 end) override;
+    QVector<ByteRange> searchRanges(QByteArray pattern, qint64 begin, qint64 end) override;
+    QString fileName() override;
+
+    // Source the document was opened from
+    std::shared_ptr<ByteSource> getBase() { return base; }
+
+    // Trigram index of the underlying file, nullptr if it can't be indexed
+    std::shared_ptr<SearchIndex> getSearchIndex() { return search_index; }
+
+    // Current contents
+    std::shared_ptr<const PieceTable> snapshot();
+
+    // Apply a run of replacements made in an earlier snapshot
+    void replace(const Replacement &replacement);
+    void replace(qint64 offset, qint64 len, const PieceTable &with);
+    void replace(qint64 offset, qint64 len, QByteArray bytes);
+
+    // Transform the bytes in [begin, end), the work is done as they are read
+    void transform(qint64 begin, qint64 end, const Transform &transform);
+
+    bool canUndo();
+    bool canRedo();
+    void undo();
+    void redo();
+
+    // Has the document changed since it was opened or last saved?
+    bool modified();
+
+    // Write the contents to fileName, progress returns false to cancel,
+    // returns false when cancelled and throws a QString on errors
+    bool save(QString fileName, const std::function<bool(qint64 done, qint64 total)> &progress);
+
+    // Buffers referenced by the undo history, released by forgetting the
+    // oldest undo steps
+    QString memoryOwner() override;
+    QString memoryKind() override { return tr("Edit history"); }
+    qint64 memoryUsage() override;
+    qint64 releaseMemory(qint64 bytes) override;
+    int reloadCost() override;
+
+signals:
+    // Emitted after every edit, undo or redo
+    void changed();
+
+private:
+    std::shared_ptr<ByteSource> base;
+    qint64 base_size;
+    QString file_name;
+    std::shared_ptr<SearchIndex> search_index;
+
+    // Undo history, the entry at history_pos is the current contents
+    std::vector<std::shared_ptr<const PieceTable>> history;
+    size_t history_pos;
+    std::shared_ptr<const PieceTable> saved;
+    std::mutex history_lock;
+
+    // Sources each entry brought into the history, the number of entries
+    // referring to every source and the memory held by all of them, kept
+    // up to date as entries come and go so no edit walks the whole history
+    std::vector<std::vector<ByteSource*>> history_sources;
+    std::unordered_map<ByteSource*, int> source_refs;
+    qint64 history_bytes;
+
+    // Account for the sources of inserted in the last entry, and forget the
+    // last or the first entry, with history_lock held
+    void addSources(const PieceTable &inserted);
+    void dropLastEntry();
+    void dropFirstEntry();
+
+    void pushTable(std::shared_ptr<const PieceTable> table, const PieceTable &inserted);
+
+private slots:
+    // The base grew (compressed sources during indexing)
+    void handleBaseGrowth();
+};
+
+#endif // DOCUMENT_H
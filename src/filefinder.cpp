@@ -0,0 +1,312 @@
+/*
+ * HexEditor -- Qt based hex editor
+ * Copyright (C) 2021  Mate Kukri
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "filefinder.h"
+#include <QDir>
+#include <QDirIterator>
+#include <QFile>
+#include <algorithm>
+#include <chrono>
+#include <sys/stat.h>
+
+// Amount of a file a worker scans at once
+static qint64 FILE_CHUNK = 4 * 1024 * 1024;
+// Most files open at the same time
+static int MAX_OPEN_FILES = 64;
+// Matches reported per file, the rest of the file is skipped
+static int MAX_FILE_MATCHES = 1000;
+// How long idle workers wait before looking for work again
+static int IDLE_WAIT = 10;
+
+FileFinder::OpenFile::~OpenFile()
+{
+    source.reset();
+    --finder->open_files;
+    ++finder->files_searched;
+    finder->work_available.notify_one();
+}
+
+FileFinder::FileFinder(QString directory, QByteArray pattern)
+    : directory(directory),
+      matcher(pattern),
+      walk_done(false),
+      opening(0),
+      open_files(0),
+      cancel(false),
+      files_searched(0),
+      files_skipped(0),
+      bytes_searched(0)
+{
+    size_t nthreads = std::max(1u, std::thread::hardware_concurrency());
+    for (size_t i = 0; i < nthreads; ++i) {
+        queues.emplace_back(new TaskQueue);
+    }
+    workers_running = static_cast<int>(nthreads);
+
+    walker = std::thread(&FileFinder::walk, this);
+    for (size_t i = 0; i < nthreads; ++i) {
+        threads.emplace_back(&FileFinder::worker, this, i);
+    }
+}
+
+FileFinder::~FileFinder()
+{
+    cancel = true;
+    work_available.notify_all();
+    walker.join();
+    for (auto &thread : threads) {
+        thread.join();
+    }
+    // Close whatever was left queued while we are still intact
+    queues.clear();
+}
+
+bool FileFinder::takeResults(std::vector<FileMatch> &out)
+{
+    // Check first, so nothing found after the check is left behind
+    bool done = workers_running == 0;
+
+    std::lock_guard<std::mutex> guard(results_lock);
+    out.insert(out.end(), results.begin(), results.end());
+    results.clear();
+    return done;
+}
+
+void FileFinder::walk()
+{
+    QDirIterator it(directory, QDir::Files | QDir::Hidden | QDir::NoSymLinks,
+                    QDirIterator::Subdirectories);
+    while (it.hasNext() && !cancel) {
+        QString path = it.next();
+        {
+            std::lock_guard<std::mutex> guard(pending_lock);
+            pending.push_back(path);
+        }
+        work_available.notify_one();
+    }
+
+    {
+        std::lock_guard<std::mutex> guard(pending_lock);
+        walk_done = true;
+    }
+    work_available.notify_all();
+}
+
+bool FileFinder::openNext(TaskQueue &queue)
+{
+    // Claim a slot under the open file limit
+    int cur = open_files;
+    do {
+        if (cur >= MAX_OPEN_FILES)
+            return false;
+    } while (!open_files.compare_exchange_weak(cur, cur + 1));
+
+    QString path;
+    {
+        std::lock_guard<std::mutex> guard(pending_lock);
+        if (pending.empty()) {
+            --open_files;
+            return false;
+        }
+        path = pending.front();
+        pending.pop_front();
+        ++opening;
+    }
+
+    // Workers waiting for the end of the search must see our chunks
+    // before they see we are done opening
+    auto done_opening = [&]() {
+        std::lock_guard<std::mutex> guard(pending_lock);
+        --opening;
+    };
+
+    auto skip = [&]() {
+        ++files_skipped;
+        --open_files;
+        done_opening();
+        return true;
+    };
+
+    // Opening anything but a regular file could block
+    struct stat st;
+    if (stat(QFile::encodeName(path).constData(), &st) < 0 || !S_ISREG(st.st_mode))
+        return skip();
+
+    std::unique_ptr<FileByteSource> source;
+    try {
+        source.reset(new FileByteSource(path));
+    } catch (QString &) {
+        return skip();
+    }
+
+    char magic[6];
+    qint64 magic_len = source->read(0, magic, sizeof magic);
+    if (ByteSource::isCompressed(QByteArray(magic, static_cast<int>(magic_len))))
+        return skip();
+
+    qint64 size = source->size();
+    if (size < matcher.length()) {
+        ++files_searched;
+        --open_files;
+        done_opening();
+        return true;
+    }
+
+    auto file = std::make_shared<OpenFile>();
+    file->finder = this;
+    file->path = path;
+    file->source = std::move(source);
+    file->size = size;
+    file->next_chunk = 0;
+    file->match_count = 0;
+    file->capped = false;
+
+    // Queued backwards, so the owner works through the file from the start
+    // while thieves take chunks from its end
+    qint64 nchunks = (size + FILE_CHUNK - 1) / FILE_CHUNK;
+    {
+        std::lock_guard<std::mutex> guard(queue.lock);
+        for (qint64 i = nchunks - 1; i >= 0; --i) {
+            queue.tasks.push_back({ file, i, i * FILE_CHUNK, std::min(size, (i + 1) * FILE_CHUNK) });
+        }
+    }
+    done_opening();
+    if (nchunks > 1) {
+        work_available.notify_all();
+    }
+    return true;
+}
+
+bool FileFinder::takeTask(size_t idx, Task &task)
+{
+    {
+        TaskQueue &own = *queues[idx];
+        std::lock_guard<std::mutex> guard(own.lock);
+        if (!own.tasks.empty()) {
+            task = std::move(own.tasks.back());
+            own.tasks.pop_back();
+            return true;
+        }
+    }
+
+    // Steal the chunk furthest away from what its owner is scanning
+    for (size_t i = 1; i < queues.size(); ++i) {
+        TaskQueue &victim = *queues[(idx + i) % queues.size()];
+        std::lock_guard<std::mutex> guard(victim.lock);
+        if (!victim.tasks.empty()) {
+            task = std::move(victim.tasks.front());
+            victim.tasks.pop_front();
+            return true;
+        }
+    }
+    return false;
+}
+
+void FileFinder::worker(size_t idx)
+{
+    TaskQueue &own = *queues[idx];
+    QByteArray buffer;
+    while (!cancel) {
+        Task task;
+        bool own_task;
+        {
+            std::lock_guard<std::mutex> guard(own.lock);
+            own_task = !own.tasks.empty();
+        }
+
+        // Opening another file keeps threads on files of their own,
+        // stealing only helps once there are none left to open
+        if (!own_task && openNext(own))
+            continue;
+
+        if (takeTask(idx, task)) {
+            scan(task, buffer);
+            continue;
+        }
+
+        bool finished;
+        {
+            std::unique_lock<std::mutex> lock(pending_lock);
+            finished = walk_done && pending.empty() && opening == 0;
+            if (!finished) {
+                work_available.wait_for(lock, std::chrono::milliseconds(IDLE_WAIT));
+            }
+        }
+        // Chunks queued before the last open finished are visible now
+        if (finished && !takeTask(idx, task))
+            break;
+        if (finished) {
+            scan(task, buffer);
+        }
+    }
+    --workers_running;
+}
+
+void FileFinder::scan(const Task &task, QByteArray &buffer)
+{
+    OpenFile &file = *task.file;
+
+    // Whatever is left past the reported matches doesn't matter
+    std::vector<qint64> hits;
+    if (!file.capped) {
+        qint64 len = std::min(file.size, task.end + matcher.length() - 1) - task.begin;
+        buffer.resize(static_cast<int>(len));
+        // A file that shrank is searched as far as it still goes
+        len = std::max<qint64>(0, file.source->read(task.begin, buffer.data(), len));
+
+        // The lowest offsets of the chunk are all a full file could need
+        qint64 pos = 0;
+        while (!cancel && hits.size() < static_cast<size_t>(MAX_FILE_MATCHES)) {
+            qint64 hit = matcher.find(buffer.constData() + pos, len - pos);
+            if (hit < 0 || task.begin + pos + hit >= task.end)
+                break;
+            hits.push_back(task.begin + pos + hit);
+            pos += hit + 1;
+        }
+    }
+    bytes_searched += task.end - task.begin;
+
+    report(file, task.chunk, std::move(hits));
+}
+
+void FileFinder::report(OpenFile &file, qint64 chunk, std::vector<qint64> hits)
+{
+    std::vector<FileMatch> found;
+    {
+        std::lock_guard<std::mutex> guard(file.lock);
+        file.done_chunks.emplace(chunk, std::move(hits));
+
+        for (auto it = file.done_chunks.begin();
+             it != file.done_chunks.end() && it->first == file.next_chunk && !file.capped;
+             it = file.done_chunks.erase(it)) {
+            for (qint64 off : it->second) {
+                if (file.match_count == MAX_FILE_MATCHES)
+                    break;
+                found.push_back({ file.path, off });
+                ++file.match_count;
+            }
+            file.capped = file.match_count == MAX_FILE_MATCHES;
+            ++file.next_chunk;
+        }
+    }
+
+    if (!found.empty()) {
+        std::lock_guard<std::mutex> guard(results_lock);
+        results.insert(results.end(), found.begin(), found.end());
+    }
+}
@@ -0,0 +1,144 @@
+/*
+ * HexEditor -- Qt based hex editor
+ * Copyright (C) 2021  Mate Kukri
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef FILEFINDER_H
+#define FILEFINDER_H
+
+#include <QByteArray>
+#include <QString>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "bytesource.h"
+#include "searcher.h"
+
+//
+// Occurrence of a pattern in a file
+//
+struct FileMatch
+{
+    QString path;
+    qint64 offset;
+};
+
+//
+// Background search for a pattern in every file below a directory
+//
+// A walker thread lists the files while a pool of workers reads and scans
+// them in chunks. Each worker queues the chunks of the files it opens on its
+// own deque and steals from the others when it runs dry, so a single huge
+// file is spread over every core while a directory full of small ones keeps
+// each core on a file of its own. Only a limited number of files are open
+// at a time. Files are read rather than mapped, so one shrinking while it is
+// searched only cuts its search short.
+//
+// Matches of a file are reported in file order, up to a limit, no matter
+// which worker scanned which chunk.
+//
+// Compressed images are skipped, offsets into them would not match what
+// the editor shows.
+//
+class FileFinder
+{
+public:
+    FileFinder(QString directory, QByteArray pattern);
+    ~FileFinder();
+
+    // Append the matches found since the last call to out,
+    // returns true once every file was searched
+    bool takeResults(std::vector<FileMatch> &out);
+
+    qint64 filesSearched() { return files_searched; }
+    qint64 filesSkipped() { return files_skipped; }
+    qint64 bytesSearched() { return bytes_searched; }
+
+private:
+    // A file being searched, closed once its last chunk is done
+    struct OpenFile {
+        FileFinder *finder;
+        QString path;
+        std::unique_ptr<FileByteSource> source;
+        qint64 size;
+
+        // Matches of chunks done ahead of an earlier one, by chunk, and the
+        // first chunk whose matches weren't reported yet
+        std::map<qint64, std::vector<qint64>> done_chunks;
+        qint64 next_chunk;
+        int match_count;
+        std::atomic<bool> capped;
+        std::mutex lock;
+        ~OpenFile();
+    };
+
+    struct Task {
+        std::shared_ptr<OpenFile> file;
+        qint64 chunk;
+        qint64 begin, end;
+    };
+
+    // Chunks queued by a worker, the owner takes from the back,
+    // thieves from the front
+    struct TaskQueue {
+        std::deque<Task> tasks;
+        std::mutex lock;
+    };
+
+    QString directory;
+    Matcher matcher;
+
+    // Files found by the walker and not opened yet
+    std::deque<QString> pending;
+    bool walk_done;
+    // Workers between taking a file and queueing its chunks
+    int opening;
+    std::mutex pending_lock;
+    std::condition_variable work_available;
+
+    std::vector<std::unique_ptr<TaskQueue>> queues;
+    std::atomic<int> open_files;
+
+    std::vector<FileMatch> results;
+    std::mutex results_lock;
+
+    std::atomic<bool> cancel;
+    std::atomic<int> workers_running;
+    std::atomic<qint64> files_searched;
+    std::atomic<qint64> files_skipped;
+    std::atomic<qint64> bytes_searched;
+    std::thread walker;
+    std::vector<std::thread> threads;
+
+    void walk();
+    void worker(size_t idx);
+
+    // Open the next pending file and queue its chunks on queue,
+    // returns false if there was nothing to open
+    bool openNext(TaskQueue &queue);
+    bool takeTask(size_t idx, Task &task);
+    void scan(const Task &task, QByteArray &buffer);
+
+    // Report the matches of a chunk once all chunks before it are done
+    void report(OpenFile &file, qint64 chunk, std::vector<qint64> hits);
+};
+
+#endif // FILEFINDER_H
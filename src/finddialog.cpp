@@ -0,0 +1,109 @@
+/*
+ * HexEditor -- Qt based hex editor
+ * Copyright (C) 2021  Mate Kukri
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "finddialog.h"
+#include <QMessageBox>
+
+FindDialog::FindDialog(bool with_replace, QWidget *parent) :
+    QDialog(parent),
+    pattern_box(this),
+    pattern_line_edit_label("Find:", &pattern_box),
+    pattern_line_edit(&pattern_box),
+    replace_box(this),
+    replace_line_edit_label("Replace:", &replace_box),
+    replace_line_edit(&replace_box),
+    hex_check_box("Hex bytes", this),
+    button_box(QDialogButtonBox::StandardButton::Ok
+               | QDialogButtonBox::StandardButton::Cancel, this)
+{
+    // Setup pattern box
+    pattern_box_layout.addWidget(&pattern_line_edit_label);
+    pattern_box_layout.addWidget(&pattern_line_edit);
+    pattern_box.setLayout(&pattern_box_layout);
+    hex_check_box.setChecked(true);
+
+    // Setup replace box
+    replace_box_layout.addWidget(&replace_line_edit_label);
+    replace_box_layout.addWidget(&replace_line_edit);
+    replace_box.setLayout(&replace_box_layout);
+    replace_box.setVisible(with_replace);
+
+    // Setup main UI
+    layout.addWidget(&pattern_box);
+    layout.addWidget(&replace_box);
+    layout.addWidget(&hex_check_box);
+    layout.addStretch();
+    layout.addWidget(&button_box);
+    setLayout(&layout);
+    setWindowTitle(with_replace ? tr("Replace All") : tr("Find"));
+    resize(400, with_replace ? 160 : 120);
+
+    // Connect event handlers
+    QObject::connect(&button_box, SIGNAL(rejected()), this, SLOT(reject()));
+    QObject::connect(&button_box, SIGNAL(accepted()), this, SLOT(validateThenAccept()));
+}
+
+QByteArray FindDialog::getPattern()
+{
+    return pattern;
+}
+
+QByteArray FindDialog::getReplacement()
+{
+    return replacement;
+}
+
+QByteArray FindDialog::parsePattern(QString text, bool hex)
+{
+    if (!hex)
+        return text.toUtf8();
+
+    // Hex digits, optionally separated by whitespace
+    QString digits = text.simplified().remove(' ');
+    if (digits.size() % 2 != 0)
+        return QByteArray();
+
+    QByteArray bytes;
+    for (int i = 0; i < digits.size(); i += 2) {
+        bool ok;
+        int val = digits.mid(i, 2).toInt(&ok, 16);
+        if (!ok)
+            return QByteArray();
+        bytes.append(static_cast<char>(val));
+    }
+    return bytes;
+}
+
+void FindDialog::validateThenAccept()
+{
+    pattern = parsePattern(pattern_line_edit.text(), hex_check_box.isChecked());
+
+    // An empty replacement deletes the matches
+    QString replace_text = replace_line_edit.text();
+    replacement = parsePattern(replace_text, hex_check_box.isChecked());
+    bool replacement_ok = replace_text.trimmed().isEmpty() || !replacement.isEmpty();
+
+    if (!pattern.isEmpty() && replacement_ok) {
+        accept();
+    } else {
+        QMessageBox msgBox(this);
+        msgBox.setText("Invalid pattern!");
+        msgBox.setIcon(QMessageBox::Icon::Critical);
+        msgBox.exec();
+    }
+}
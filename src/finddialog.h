@@ -0,0 +1,64 @@
+/*
+ * HexEditor -- Qt based hex editor
+ * Copyright (C) 2021  Mate Kukri
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef FINDDIALOG_H
+#define FINDDIALOG_H
+
+#include <QCheckBox>
+#include <QDialog>
+#include <QDialogButtonBox>
+#include <QLineEdit>
+#include <QHBoxLayout>
+#include <QVBoxLayout>
+#include <QLabel>
+
+class FindDialog : public QDialog
+{
+    Q_OBJECT
+
+public:
+    explicit FindDialog(bool with_replace, QWidget *parent = nullptr);
+    QByteArray getPattern();
+    QByteArray getReplacement();
+
+    // Parse a pattern typed by the user, returns an empty array if invalid
+    static QByteArray parsePattern(QString text, bool hex);
+
+private:
+    // UI
+    QWidget pattern_box;
+    QLabel pattern_line_edit_label;
+    QLineEdit pattern_line_edit;
+    QHBoxLayout pattern_box_layout;
+    QWidget replace_box;
+    QLabel replace_line_edit_label;
+    QLineEdit replace_line_edit;
+    QHBoxLayout replace_box_layout;
+    QCheckBox hex_check_box;
+    QDialogButtonBox button_box;
+    QVBoxLayout layout;
+
+    // Saved values
+    QByteArray pattern;
+    QByteArray replacement;
+
+private slots:
+    void validateThenAccept();
+};
+
+#endif // FINDDIALOG_H
@@ -0,0 +1,185 @@
+/*
+ * HexEditor -- Qt based hex editor
+ * Copyright (C) 2021  Mate Kukri
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "findinfilesdialog.h"
+#include "finddialog.h"
+#include <QDir>
+#include <QFileDialog>
+#include <QHeaderView>
+#include <QMessageBox>
+
+// How often results are collected while a search runs
+static int POLL_INTERVAL = 100;
+
+FindInFilesDialog::FindInFilesDialog(QWidget *parent) :
+    QDialog(parent),
+    directory_box(this),
+    directory_line_edit_label("Directory:", &directory_box),
+    directory_line_edit(&directory_box),
+    browse_button("Browse...", &directory_box),
+    pattern_box(this),
+    pattern_line_edit_label("Find:", &pattern_box),
+    pattern_line_edit(&pattern_box),
+    hex_check_box("Hex bytes", &pattern_box),
+    search_button("Search", &pattern_box),
+    results_tree(this),
+    status_label(this)
+{
+    // Setup directory box
+    directory_line_edit.setText(QDir::currentPath());
+    directory_box_layout.addWidget(&directory_line_edit_label);
+    directory_box_layout.addWidget(&directory_line_edit);
+    directory_box_layout.addWidget(&browse_button);
+    directory_box_layout.setMargin(0);
+    directory_box.setLayout(&directory_box_layout);
+
+    // Setup pattern box
+    hex_check_box.setChecked(true);
+    pattern_box_layout.addWidget(&pattern_line_edit_label);
+    pattern_box_layout.addWidget(&pattern_line_edit);
+    pattern_box_layout.addWidget(&hex_check_box);
+    pattern_box_layout.addWidget(&search_button);
+    pattern_box_layout.setMargin(0);
+    pattern_box.setLayout(&pattern_box_layout);
+
+    // Setup results
+    results_tree.setColumnCount(2);
+    results_tree.setHeaderLabels({ tr("File"), tr("Offset") });
+    results_tree.setRootIsDecorated(false);
+    results_tree.setUniformRowHeights(true);
+    results_tree.header()->setSectionResizeMode(0, QHeaderView::Stretch);
+    results_tree.header()->setStretchLastSection(false);
+
+    // Setup main UI
+    layout.addWidget(&directory_box);
+    layout.addWidget(&pattern_box);
+    layout.addWidget(&results_tree);
+    layout.addWidget(&status_label);
+    setLayout(&layout);
+    setWindowTitle(tr("Find in Files"));
+    resize(600, 400);
+
+    poll_timer.setInterval(POLL_INTERVAL);
+
+    // Connect event handlers
+    QObject::connect(&browse_button, SIGNAL(clicked()), this, SLOT(handleBrowse()));
+    QObject::connect(&search_button, SIGNAL(clicked()), this, SLOT(handleSearch()));
+    QObject::connect(&pattern_line_edit, SIGNAL(returnPressed()), this, SLOT(handleSearch()));
+    QObject::connect(&poll_timer, SIGNAL(timeout()), this, SLOT(handlePoll()));
+    QObject::connect(&results_tree, SIGNAL(itemClicked(QTreeWidgetItem*, int)),
+                     this, SLOT(handleItemClicked(QTreeWidgetItem*)));
+}
+
+void FindInFilesDialog::hideEvent(QHideEvent *event)
+{
+    // Nobody is looking at the results anymore
+    stop();
+    QDialog::hideEvent(event);
+}
+
+void FindInFilesDialog::stop()
+{
+    poll_timer.stop();
+    finder.reset();
+    search_button.setText("Search");
+}
+
+void FindInFilesDialog::handleBrowse()
+{
+    QString dir = QFileDialog::getExistingDirectory(this, tr("Find in Files"), directory_line_edit.text());
+    if (!dir.isEmpty()) {
+        directory_line_edit.setText(dir);
+    }
+}
+
+void FindInFilesDialog::handleSearch()
+{
+    // The button doubles as stop while a search runs
+    if (finder) {
+        handlePoll();
+        if (finder) {
+            updateStatus(true);
+        }
+        stop();
+        return;
+    }
+
+    pattern = FindDialog::parsePattern(pattern_line_edit.text(), hex_check_box.isChecked());
+    if (pattern.isEmpty() || !QDir(directory_line_edit.text()).exists()) {
+        QMessageBox msgBox(this);
+        msgBox.setText(pattern.isEmpty() ? "Invalid pattern!" : "Invalid directory!");
+        msgBox.setIcon(QMessageBox::Icon::Critical);
+        msgBox.exec();
+        return;
+    }
+
+    results_tree.clear();
+    finder.reset(new FileFinder(directory_line_edit.text(), pattern));
+    search_button.setText("Stop");
+    poll_timer.start();
+}
+
+void FindInFilesDialog::updateStatus(bool done)
+{
+    QString status = QString("%1 matches in %2 files searched (%3 MiB)")
+        .arg(results_tree.topLevelItemCount())
+        .arg(finder->filesSearched())
+        .arg(finder->bytesSearched() / (1024 * 1024));
+    if (finder->filesSkipped() > 0) {
+        status += QString(", %1 skipped").arg(finder->filesSkipped());
+    }
+    if (!done) {
+        status += "...";
+    }
+    status_label.setText(status);
+}
+
+void FindInFilesDialog::handlePoll()
+{
+    if (!finder)
+        return;
+
+    std::vector<FileMatch> matches;
+    bool done = finder->takeResults(matches);
+
+    QDir dir(directory_line_edit.text());
+    QList<QTreeWidgetItem*> items;
+    for (auto &match : matches) {
+        auto item = new QTreeWidgetItem;
+        item->setText(0, dir.relativeFilePath(match.path));
+        item->setText(1, QString::asprintf("%llx", static_cast<unsigned long long>(match.offset)));
+        item->setData(0, Qt::UserRole, match.path);
+        item->setData(1, Qt::UserRole, match.offset);
+        items.append(item);
+    }
+    results_tree.addTopLevelItems(items);
+
+    updateStatus(done);
+    if (done) {
+        poll_timer.stop();
+        finder.reset();
+        search_button.setText("Search");
+    }
+}
+
+void FindInFilesDialog::handleItemClicked(QTreeWidgetItem *item)
+{
+    emit matchActivated(item->data(0, Qt::UserRole).toString(),
+                        item->data(1, Qt::UserRole).toLongLong(),
+                        pattern.size());
+}
@@ -0,0 +1,82 @@
+/*
+ * HexEditor -- Qt based hex editor
+ * Copyright (C) 2021  Mate Kukri
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef FINDINFILESDIALOG_H
+#define FINDINFILESDIALOG_H
+
+#include <QCheckBox>
+#include <QDialog>
+#include <QHBoxLayout>
+#include <QLabel>
+#include <QLineEdit>
+#include <QPushButton>
+#include <QTimer>
+#include <QTreeWidget>
+#include <QVBoxLayout>
+#include <memory>
+#include "filefinder.h"
+
+//
+// Search for a pattern in every file below a directory
+//
+class FindInFilesDialog : public QDialog
+{
+    Q_OBJECT
+
+public:
+    explicit FindInFilesDialog(QWidget *parent = nullptr);
+
+protected:
+    void hideEvent(QHideEvent *event) override;
+
+signals:
+    // A match was clicked
+    void matchActivated(QString path, qint64 offset, qint64 length);
+
+private:
+    // UI
+    QWidget directory_box;
+    QLabel directory_line_edit_label;
+    QLineEdit directory_line_edit;
+    QPushButton browse_button;
+    QHBoxLayout directory_box_layout;
+    QWidget pattern_box;
+    QLabel pattern_line_edit_label;
+    QLineEdit pattern_line_edit;
+    QCheckBox hex_check_box;
+    QPushButton search_button;
+    QHBoxLayout pattern_box_layout;
+    QTreeWidget results_tree;
+    QLabel status_label;
+    QVBoxLayout layout;
+
+    QTimer poll_timer;
+    std::unique_ptr<FileFinder> finder;
+    QByteArray pattern;
+
+    void stop();
+    void updateStatus(bool done);
+
+private slots:
+    void handleBrowse();
+    void handleSearch();
+    void handlePoll();
+    void handleItemClicked(QTreeWidgetItem *item);
+};
+
+#endif // FINDINFILESDIALOG_H
@@ -24,61 +24,138 @@
 #include <QStyle>
 #include <QKeyEvent>
 #include <QKeySequence>
+#include <algorithm>
 
 static int    FONT_SIZE = 10;
-static int    BYTES_PER_LINE = 16;
-static int    SPLITAT = 8;
 static int    GAP = 10;
 static int    BIGGAP = 20;
 static QColor BLACK(0, 0, 0);
 static QColor WHITE(255, 255, 255);
 static QColor BLUE(0, 70, 255);
 static QColor GRAY(119, 119, 119);
-
-#define BPL_MASK (BYTES_PER_LINE - 1)
+// Background of bytes covered by template fields
+static QColor FIELD_SHADE(220, 230, 255);
+// Widest row the header can label with two digits
+static int    MAX_ROW_WIDTH = 255;
 
 HexWidget::HexWidget(QString fileName, QMenu &context_menu, QWidget *parent)
+    : HexWidget(ByteSource::open(fileName), context_menu, parent)
+{
+    path = fileName;
+}
+
+HexWidget::HexWidget(std::shared_ptr<ByteSource> source, QMenu &context_menu, QWidget *parent)
     : QWidget(parent),
       scroll_bar(this),
       context_menu(context_menu),
-      file(fileName),
+      document(std::make_shared<Document>(source)),
       font("DejaVu Sans Mono", FONT_SIZE),
       font_metrics(font),
+      top_line(0),
+      lines_per_step(1),
+      wheel_delta(0),
       cursor_pos(0),
       cursor_deflect(CursorDeflect::NoDeflect)
 {
-    file.open(QFile::ReadOnly);
-    if (file.error() != QFile::FileError::NoError) {
-        throw file.errorString();
-    }
-
     // Setup scrollbar
-    qint64 total_lines = (file.size() + BYTES_PER_LINE - 1) / BYTES_PER_LINE;
-    if (total_lines > INT_MAX) {
-        // TODO: fixme, somehow, scrollbars suck in Qt ;(
-        throw QString("File too big to display!");
-    }
-    QObject::connect(&scroll_bar, SIGNAL(valueChanged(int)), this, SLOT(repaint()));
-    scroll_bar.setRange(0, static_cast<int>(total_lines - 1));
+    QObject::connect(&scroll_bar, SIGNAL(valueChanged(int)), this, SLOT(handleScroll(int)));
+    // Compressed sources grow while their index is being built
+    QObject::connect(document.get(), SIGNAL(sizeChanged()), this, SLOT(handleSizeChanged()));
+    QObject::connect(document.get(), SIGNAL(changed()), this, SLOT(handleDocumentChanged()));
+    updateScrollRange();
     scroll_bar.show();
 
-
     setFocusPolicy(Qt::StrongFocus);
     setMouseTracking(true);
 }
 
 HexWidget::~HexWidget()
 {
-    file.close();
 }
 
 qint64 HexWidget::fileSize()
 {
-    return file.size();
+    return document->size();
+}
+
+void HexWidget::setRowWidth(int width)
+{
+    width = std::min(std::max(width, 1), MAX_ROW_WIDTH);
+    if (width == row.width())
+        return;
+
+    // Keep the first byte on screen in the first line
+    qint64 top_offs = row.lineStart(top_line);
+    row = RowLayout(width);
+    updateScrollRange();
+    setTopLine(row.lineOf(top_offs));
+}
+
+void HexWidget::updateScrollRange()
+{
+    qint64 total_lines = row.lineCount(document->size());
+    qint64 max_line = total_lines > 0 ? total_lines - 1 : 0;
+
+    // Make sure the scrollbar range fits into an int
+    lines_per_step = max_line / INT_MAX + 1;
+    scroll_bar.blockSignals(true);
+    scroll_bar.setRange(0, static_cast<int>(max_line / lines_per_step));
+    scroll_bar.setValue(static_cast<int>(top_line / lines_per_step));
+    scroll_bar.blockSignals(false);
+    update();
+}
+
+void HexWidget::handleSizeChanged()
+{
+    updateScrollRange();
+    if (!pending_view)
+        return;
+
+    PendingView view = *pending_view;
+    if (std::max({ view.pivot, view.cursor, row.lineStart(view.line) }) <= document->size()) {
+        restoreView(view.pivot, view.cursor, view.line);
+    }
+}
+
+void HexWidget::handleDocumentChanged()
+{
+    pending_view.reset();
+    // Keep the view inside the document if it shrunk
+    updateScrollRange();
+    if (cursor_pos > document->size()) {
+        cursorToOffset(document->size(), CursorDeflect::NoDeflect);
+    }
+    setTopLine(top_line);
+    emit documentChanged();
+}
+
+void HexWidget::handleScroll(int value)
+{
+    pending_view.reset();
+    top_line = static_cast<qint64>(value) * lines_per_step;
+    repaint();
+}
+
+void HexWidget::setTopLine(qint64 line)
+{
+    qint64 total_lines = row.lineCount(document->size());
+    if (line >= total_lines) {
+        line = total_lines - 1;
+    }
+    if (line < 0) {
+        line = 0;
+    }
+
+    top_line = line;
+    scroll_bar.blockSignals(true);
+    scroll_bar.setValue(static_cast<int>(top_line / lines_per_step));
+    scroll_bar.blockSignals(false);
+    repaint();
 }
 
 void HexWidget::cursorToOffset(qint64 offset, CursorDeflect deflect, bool extend)
 {
+    pending_view.reset();
     if (offset < 0)
         return;
 
@@ -93,17 +170,17 @@ void HexWidget::cursorToOffset(qint64 offset, CursorDeflect deflect, bool extend
     auto prev_cursor_offs = cursor_pos;
     auto prev_cursor_deflect = cursor_deflect;
 
-    if (offset >= file.size()) {
+    if (offset >= document->size()) {
         // Always deflect at EOF
-        offset = file.size();
+        offset = document->size();
         cursor_deflect = CursorDeflect::ToPrevious;
-    } else if (selection.valid() && cursor_pos > selection.pivotVal() && offset & BPL_MASK) {
+    } else if (selection.valid() && cursor_pos > selection.pivotVal() && row.columnOf(offset)) {
         // After the selection
         cursor_deflect = CursorDeflect::ToPrevious;
     } else if (deflect != CursorDeflect::PreserveEol) {
         // No preserve instructed
         cursor_deflect = deflect;
-    } else if (offset & BPL_MASK) {
+    } else if (row.columnOf(offset)) {
         // Ignore preserve when not at EOL
         cursor_deflect = CursorDeflect::NoDeflect;
     }
@@ -113,31 +190,86 @@ void HexWidget::cursorToOffset(qint64 offset, CursorDeflect deflect, bool extend
         if (!isCursorOnScreen(prev_cursor_offs, prev_cursor_deflect)) {
             // Cursor was not on screen -> just put the exact line on the
             // top of the screen
-            scroll_bar.setValue(static_cast<int>(cursor_pos / BYTES_PER_LINE));
+            setTopLine(row.lineOf(cursor_pos));
         } else {
             // If the new cursor is not on screen, we know the exact number of
             // lines we need to move the screen
-            auto delta = static_cast<int>(cursor_pos / BYTES_PER_LINE
-                                          - prev_cursor_offs / BYTES_PER_LINE);
-            scroll_bar.setValue(scroll_bar.value() + delta);
+            auto delta = row.lineOf(cursor_pos) - row.lineOf(prev_cursor_offs);
+            setTopLine(top_line + delta);
         }
     }
 
     repaint();
 }
 
+QString HexWidget::getPath()
+{
+    // Save As moves the document somewhere else
+    QString saved_as = document->fileName();
+    return saved_as.isEmpty() ? path : saved_as;
+}
+
+void HexWidget::restoreView(qint64 pivot, qint64 cursor, qint64 line)
+{
+    // Compressed sources only grow to their full size while being indexed
+    if (std::max({ pivot, cursor, row.lineStart(line) }) > document->size()) {
+        pending_view = PendingView { pivot, cursor, line };
+        return;
+    }
+
+    cursorToOffset(pivot, CursorDeflect::NoDeflect);
+    if (cursor != pivot) {
+        cursorToOffset(cursor, CursorDeflect::ToPrevious, true);
+    }
+    setTopLine(line);
+}
+
+void HexWidget::finishRestoreView()
+{
+    if (!pending_view)
+        return;
+
+    PendingView view = *pending_view;
+    pending_view.reset();
+    cursorToOffset(std::min(view.pivot, document->size()), CursorDeflect::NoDeflect);
+    if (view.cursor != view.pivot) {
+        cursorToOffset(std::min(view.cursor, document->size()), CursorDeflect::ToPrevious, true);
+    }
+    setTopLine(view.line);
+}
+
+void HexWidget::selectRange(qint64 begin, qint64 end)
+{
+    cursorToOffset(begin, CursorDeflect::NoDeflect);
+    cursorToOffset(end, CursorDeflect::ToPrevious, true);
+}
+
+void HexWidget::setAnnotations(std::shared_ptr<TemplateInstance> instance)
+{
+    annotations = instance;
+    update();
+}
+
 std::optional<QByteArray> HexWidget::getSelectedBytes()
 {
     if (!selection.valid())
         return {};
 
-    file_lock.lock();
-    file.seek(selection.begin());
-    QByteArray bytes = file.read(selection.end() - selection.begin());
-    file_lock.unlock();
+    // Selections too large for a QByteArray read as null
+    QByteArray bytes = document->read(selection.begin(), selection.end() - selection.begin());
+    if (bytes.isNull())
+        return {};
     return std::optional(bytes);
 }
 
+std::optional<ByteRange> HexWidget::getSelectedRange()
+{
+    if (!selection.valid())
+        return {};
+
+    return ByteRange { selection.begin(), selection.end() };
+}
+
 qint64 HexWidget::maxDisplayedLines()
 {
     return (this->height() - 30) / font_metrics.height();
@@ -145,8 +277,8 @@ qint64 HexWidget::maxDisplayedLines()
 
 bool HexWidget::isCursorOnScreen(qint64 pos, CursorDeflect deflect)
 {
-    qint64 screen_offs = scroll_bar.value() * BYTES_PER_LINE;
-    qint64 screen_end = screen_offs + maxDisplayedLines() * BYTES_PER_LINE;
+    qint64 screen_offs = row.lineStart(top_line);
+    qint64 screen_end = row.lineStart(top_line + maxDisplayedLines());
 
     // Take deflection into account
     if (deflect == CursorDeflect::ToPrevious && pos > 0) {
@@ -170,14 +302,14 @@ qint64 HexWidget::guiToOffset(int gui_x, int gui_y, CursorDeflect &deflect)
     qint64 y = gui_y - grid_y;
 
     // Account for the split in the middle
-    if (x / cell_width > SPLITAT) {
+    if (row.splitAt() >= 0 && x / cell_width > row.splitAt()) {
         x -= GAP;
     }
 
     // Calculate cell x coord
     x /= cell_width;
-    if (x >= BYTES_PER_LINE) {
-        x = BYTES_PER_LINE;
+    if (x >= row.width()) {
+        x = row.width();
         deflect = CursorDeflect::ToPrevious;
     } else {
         deflect = CursorDeflect::NoDeflect;
@@ -189,7 +321,7 @@ qint64 HexWidget::guiToOffset(int gui_x, int gui_y, CursorDeflect &deflect)
         y = maxDisplayedLines();
     }
 
-    return (scroll_bar.value() + y) * BYTES_PER_LINE + x;
+    return row.lineStart(top_line + y) + x;
 }
 
 void HexWidget::contextMenuEvent(QContextMenuEvent *event)
@@ -212,7 +344,7 @@ void HexWidget::mousePressEvent(QMouseEvent *event)
 void HexWidget::mouseMoveEvent(QMouseEvent *event)
 {
     if (event->x() >= grid_x
-            && event->x() < grid_x + BYTES_PER_LINE * cell_width + 2 * GAP
+            && event->x() < grid_x + row.width() * cell_width + 2 * GAP
             && event->y() >= grid_y) {
         setCursor(Qt::CursorShape::IBeamCursor);
     } else {
@@ -230,16 +362,16 @@ void HexWidget::keyPressEvent(QKeyEvent *event)
 {
     switch (event->key()) {
     case Qt::Key_Up:
-        cursorToOffset(cursor_pos - BYTES_PER_LINE, CursorDeflect::PreserveEol);
+        cursorToOffset(cursor_pos - row.width(), CursorDeflect::PreserveEol);
         break;
     case Qt::Key_Down:
-        cursorToOffset(cursor_pos + BYTES_PER_LINE, CursorDeflect::PreserveEol);
+        cursorToOffset(cursor_pos + row.width(), CursorDeflect::PreserveEol);
         break;
     case Qt::Key_PageUp:
-        cursorToOffset(cursor_pos - BYTES_PER_LINE * maxDisplayedLines(), CursorDeflect::PreserveEol);
+        cursorToOffset(cursor_pos - row.lineStart(maxDisplayedLines()), CursorDeflect::PreserveEol);
         break;
     case Qt::Key_PageDown:
-        cursorToOffset(cursor_pos + BYTES_PER_LINE * maxDisplayedLines(), CursorDeflect::PreserveEol);
+        cursorToOffset(cursor_pos + row.lineStart(maxDisplayedLines()), CursorDeflect::PreserveEol);
         break;
     case Qt::Key_Left:
         cursorToOffset(cursor_pos - 1, CursorDeflect::NoDeflect);
@@ -248,17 +380,29 @@ void HexWidget::keyPressEvent(QKeyEvent *event)
         cursorToOffset(cursor_pos + 1, CursorDeflect::NoDeflect);
         break;
     case Qt::Key_Home:
-        cursorToOffset((cursor_pos - cursor_deflect) & ~BPL_MASK, CursorDeflect::NoDeflect);
+        if (cursor_pos - cursor_deflect >= 0) {
+            qint64 line = row.lineOf(cursor_pos - cursor_deflect);
+            cursorToOffset(row.lineStart(line), CursorDeflect::NoDeflect);
+        }
         break;
     case Qt::Key_End:
-        cursorToOffset(((cursor_pos - cursor_deflect) | BPL_MASK) + 1, CursorDeflect::ToPrevious);
+        if (cursor_pos - cursor_deflect >= 0) {
+            qint64 line = row.lineOf(cursor_pos - cursor_deflect);
+            cursorToOffset(row.lineStart(line + 1), CursorDeflect::ToPrevious);
+        }
         break;
     }
 }
 
 void HexWidget::wheelEvent(QWheelEvent *event)
 {
-    scroll_bar.event(event);
+    pending_view.reset();
+    // Scroll by lines ourselves, a scrollbar step might be many lines,
+    // a notch is 120 so keep what's left of fractional deltas for later
+    wheel_delta += event->angleDelta().y() * QApplication::wheelScrollLines();
+    int lines = wheel_delta / 120;
+    wheel_delta %= 120;
+    setTopLine(top_line - lines);
 }
 
 void HexWidget::resizeEvent(QResizeEvent *)
@@ -276,17 +420,24 @@ void HexWidget::paintEvent(QPaintEvent *)
     int x = BIGGAP;
     int y = BIGGAP;
 
+    // Widen the offset column for sources beyond 32-bit
+    int offs_digits = 8;
+    while (offs_digits < 16 && (document->size() >> (4 * offs_digits)) != 0) {
+        ++offs_digits;
+    }
+
     // Draw heading
     QString offs_heading("Offset(hex)");
     painter.drawText(x, y, offs_heading);
-    x += font_metrics.width(offs_heading) + BIGGAP;
+    x += std::max(font_metrics.width(offs_heading),
+                  font_metrics.width(QString(offs_digits, '0'))) + BIGGAP;
 
     int byte_start = x;
-    for (int i = 0; i < BYTES_PER_LINE; ++i) {
+    for (int i = 0; i < row.width(); ++i) {
         auto num_str = QString::asprintf("%02X", i);
         painter.drawText(x, y, num_str);
         x += font_metrics.width(num_str);
-        if (i == SPLITAT - 1) {
+        if (i == row.splitAt() - 1) {
             x += BIGGAP;
         } else {
             x += GAP;
@@ -305,17 +456,36 @@ void HexWidget::paintEvent(QPaintEvent *)
     cell_height = font_metrics.height();
 
     // Draw file contents
-    file_lock.lock();
-    file.seek(scroll_bar.value() * BYTES_PER_LINE);
+    qint64 screen_offs = row.lineStart(top_line);
+    qint64 screen_len = row.lineStart(maxDisplayedLines());
+    QByteArray screen = document->read(screen_offs, screen_len);
+
+    // Sparse sources have gaps which are drawn as blanks
+    auto mapped = document->mappedRanges(screen_offs, screen_offs + screen_len);
+    int mapped_idx = 0;
+    auto isMapped = [&](qint64 offs) {
+        while (mapped_idx < mapped.size() && mapped[mapped_idx].end <= offs) {
+            ++mapped_idx;
+        }
+        return mapped_idx < mapped.size() && mapped[mapped_idx].begin <= offs;
+    };
+
+    // Only the fields on screen are decoded
+    std::vector<TemplateInstance::FieldSpan> fields;
+    if (annotations) {
+        fields = annotations->fieldsIn(screen_offs, screen_offs + screen.size());
+    }
+    size_t field_idx = 0;
+
     for (int line_idx = 0; line_idx < maxDisplayedLines(); ++line_idx) {
-        // Read data
-        auto hexline_offs = file.pos();
-        auto hexline = file.read(BYTES_PER_LINE);
+        // Slice line
+        qint64 hexline_offs = screen_offs + row.lineStart(line_idx);
+        auto hexline = screen.mid(static_cast<int>(row.lineStart(line_idx)), row.width());
         if (hexline.size() == 0)
             break;
 
         // Draw offset
-        auto offs_str = QString::asprintf("%08llx", hexline_offs);
+        auto offs_str = QString::asprintf("%0*llx", offs_digits, hexline_offs);
         painter.setPen(BLUE);
         x = BIGGAP;
         y += font_metrics.height();
@@ -329,7 +499,10 @@ void HexWidget::paintEvent(QPaintEvent *)
             qint64 cell_offs = hexline_offs + col_idx;
 
             // The byte as a string
-            auto bstr = QString::asprintf("%02X", static_cast<unsigned char>(hexline.at(col_idx)));
+            bool cell_mapped = isMapped(cell_offs);
+            auto bstr = cell_mapped
+                ? QString::asprintf("%02X", static_cast<unsigned char>(hexline.at(col_idx)))
+                : QString("  ");
 
             // Byte value x
             auto bstr_x = x;
@@ -346,7 +519,22 @@ void HexWidget::paintEvent(QPaintEvent *)
 
             // Add gap width if this is not the last column
             if (col_idx != hexline.size() - 1) {
-                x += (col_idx == SPLITAT - 1 ? BIGGAP : GAP);
+                x += (col_idx == row.splitAt() - 1 ? BIGGAP : GAP);
+            }
+
+            // Shade template fields, with a bar where each one starts
+            while (field_idx < fields.size() && fields[field_idx].end <= cell_offs) {
+                ++field_idx;
+            }
+            if (field_idx < fields.size() && fields[field_idx].begin <= cell_offs) {
+                int field_width = x - bstr_x;
+                if (cell_offs == fields[field_idx].end - 1) {
+                    field_width = bstr_end_x - bstr_x;
+                }
+                painter.fillRect(bstr_x, y + 4, field_width, -font_metrics.height(), FIELD_SHADE);
+                if (cell_offs == fields[field_idx].begin) {
+                    painter.fillRect(bstr_x - 2, y + 4, 1, -font_metrics.height(), GRAY);
+                }
             }
 
             // Draw byte
@@ -366,8 +554,13 @@ void HexWidget::paintEvent(QPaintEvent *)
 
         // Draw ASCII
         QString asciiLine;
-        for (char byteVal : hexline) {
-            if (31 < byteVal && byteVal < 127) {
+        mapped_idx = 0;
+        for (int col_idx = 0; col_idx < hexline.size(); ++col_idx) {
+            char byteVal = hexline.at(col_idx);
+            if (!isMapped(hexline_offs + col_idx)) {
+                // Gap in a sparse source
+                asciiLine.append(' ');
+            } else if (31 < byteVal && byteVal < 127) {
                 // Printable ASCII char
                 asciiLine.append(QChar::fromLatin1(byteVal));
             } else {
@@ -377,5 +570,4 @@ void HexWidget::paintEvent(QPaintEvent *)
         }
         painter.drawText(ascii_start, y, asciiLine);
     }
-    file_lock.unlock();
 }
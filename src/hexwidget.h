@@ -21,10 +21,12 @@
 
 #include <QWidget>
 #include <QScrollBar>
-#include <QFile>
 #include <QMenu>
+#include <memory>
 #include <optional>
-#include <mutex>
+#include "document.h"
+#include "rowlayout.h"
+#include "structtemplate.h"
 
 class Selection
 {
@@ -57,15 +59,43 @@ class HexWidget : public QWidget
 
 public:
     explicit HexWidget(QString fileName, QMenu &context_menu, QWidget *parent = nullptr);
+    explicit HexWidget(std::shared_ptr<ByteSource> source, QMenu &context_menu, QWidget *parent = nullptr);
     ~HexWidget() override;
 
     qint64 fileSize();
+    // A view still waiting to be restored counts as the current one
+    qint64 cursorPos() { return pending_view ? pending_view->cursor : cursor_pos; }
+    qint64 selectionPivot() { return pending_view ? pending_view->pivot : selection.pivotVal(); }
+    qint64 topLine() { return pending_view ? pending_view->line : top_line; }
+    int rowWidth() { return row.width(); }
+    std::shared_ptr<Document> getDocument() { return document; }
+
+    // Path the widget was opened from, empty for processes
+    QString getPath();
+
+    // Show width bytes per line
+    void setRowWidth(int width);
+
+    // Put back a selection from pivot to cursor and the scroll position,
+    // sources still growing get it once they are long enough for it
+    void restoreView(qint64 pivot, qint64 cursor, qint64 line);
+
+    // The source stopped growing, restore a view waiting for it as far
+    // as the document goes
+    void finishRestoreView();
 
     void cursorToOffset(qint64 offset,
                         CursorDeflect deflect,
                         bool extend_selection=false);
 
+    // Select [begin, end) and move the cursor to its end
+    void selectRange(qint64 begin, qint64 end);
+
+    // Mark the fields of instance, nullptr to remove the marks
+    void setAnnotations(std::shared_ptr<TemplateInstance> instance);
+
     std::optional<QByteArray> getSelectedBytes();
+    std::optional<ByteRange> getSelectedRange();
 
     virtual void contextMenuEvent(QContextMenuEvent *) override;
     virtual void mousePressEvent(QMouseEvent *) override;
@@ -75,19 +105,45 @@ public:
     virtual void resizeEvent(QResizeEvent *) override;
     virtual void paintEvent(QPaintEvent *) override;
 
+signals:
+    // Contents of the document changed through an edit, undo or redo
+    void documentChanged();
+
 private:
     QScrollBar scroll_bar;
     Selection selection;
     QMenu &context_menu;
 
-    // Underlying file
-    QFile file;
-    std::mutex file_lock;
+    // Edited view of the underlying data
+    std::shared_ptr<Document> document;
+    QString path;
 
     // For rendering fonts
     QFont font;
     QFontMetrics font_metrics;
 
+    // Bytes per line
+    RowLayout row;
+
+    // Template whose fields are marked on screen
+    std::shared_ptr<TemplateInstance> annotations;
+
+    // View to restore once the document covers it, dropped as soon as the
+    // user moves or edits
+    struct PendingView {
+        qint64 pivot, cursor, line;
+    };
+    std::optional<PendingView> pending_view;
+
+    // First line on screen, the scrollbar only has an int range so for
+    // huge address spaces each scrollbar step covers several lines
+    qint64 top_line;
+    qint64 lines_per_step;
+
+    // Wheel rotation (in 120ths of a line) not yet scrolled, touchpads and
+    // high-resolution wheels deliver fractions of a notch
+    int wheel_delta;
+
     // Cursor position
     qint64 cursor_pos;
     CursorDeflect cursor_deflect;
@@ -107,6 +163,20 @@ private:
 
     // Translate GUI coordinates into an offset into file
     qint64 guiToOffset(int x, int y, CursorDeflect &deflect);
+
+    // Scroll so that line is at the top of the screen
+    void setTopLine(qint64 line);
+
+private slots:
+    // Adjust the scrollbar after the size of the source changed
+    void updateScrollRange();
+    void handleSizeChanged();
+
+    // Document was edited
+    void handleDocumentChanged();
+
+    // Scrollbar was moved by the user
+    void handleScroll(int value);
 };
 
 #endif // HEXWIDGET_H
@@ -23,6 +23,8 @@
 int main(int argc, char *argv[])
 {
     QApplication a(argc, argv);
+    a.setOrganizationName("HexEditor");
+    a.setApplicationName("HexEditor");
     MainWindow w;
     w.show();
 
@@ -17,41 +17,83 @@
  */
 
 #include "mainwindow.h"
+#include "backgroundjob.h"
+#include "compressedsource.h"
 #include "hexwidget.h"
+#include "processsource.h"
+#include "searcher.h"
 #include <QApplication>
 #include <QDesktopWidget>
 #include <QDebug>
 #include <QFileDialog>
 #include <QFileInfo>
+#include <QInputDialog>
 #include <QSizePolicy>
 #include <QKeyEvent>
 #include <QMessageBox>
 #include <QScreen>
+#include <QStatusBar>
 #include <QClipboard>
+#include <QCloseEvent>
+#include <QProgressDialog>
+
+// Number of tabs opened ahead of time around the current one
+static int PREWARM_TABS = 2;
+// Idle time after switching tabs before opening the next one
+static int PREWARM_DELAY = 300;
+
+// Compressed images needing more decompression than this to reach an
+// offset are reported as slow to browse
+static qint64 SLOW_SEEK_SPAN = 64 * 1024 * 1024;
+
+// Row widths offered in the View menu
+static int ROW_WIDTHS[] = { 8, 16, 24, 32, 48, 64 };
 
 MainWindow::MainWindow(QWidget *parent) :
     QMainWindow(parent),
     action_open("&Open"),
+    action_open_process("Open &Process"),
     action_save("&Save"),
     action_save_as("S&ave As"),
     action_quit("&Quit"),
     file_menu("&File"),
+    action_undo("&Undo"),
+    action_redo("&Redo"),
     action_copy("&Copy"),
     action_cut("C&ut"),
     action_paste("Paste &Write"),
     action_paste_insert("Paste &Insert"),
     action_copy_offset("Copy Cursor &Offset"),
     action_fill("&Fill Selection"),
+    action_transform("&Transform Selection..."),
     edit_menu("&Edit"),
+    action_find("&Find"),
+    action_find_next("Find &Next"),
+    action_replace_all("&Replace All"),
+    action_build_index("Build Search &Index"),
+    action_find_in_files("Find in &Files"),
     action_goto("&Goto offset"),
     find_menu("Fi&nd"),
+    action_custom_row_width("&Custom..."),
+    row_width_menu("Row &Width"),
+    action_memory_usage("&Memory Usage"),
+    view_menu("&View"),
     menu_bar(this),
     central_widget(this),
     editor_tabs(&central_widget),
-    gotoDialog(this)
+    strings_panel(this),
+    struct_panel(this),
+    gotoDialog(this),
+    findDialog(false, this),
+    replaceDialog(true, this),
+    memoryDialog(this),
+    findInFilesDialog(this),
+    transformDialog(this),
+    clipboard(this)
 {
     action_open.setShortcut(QKeySequence("Ctrl+O"));
     file_menu.addAction(&action_open);
+    file_menu.addAction(&action_open_process);
     action_save.setShortcut(QKeySequence("Ctrl+S"));
     file_menu.addAction(&action_save);
     file_menu.addAction(&action_save_as);
@@ -60,6 +102,11 @@ MainWindow::MainWindow(QWidget *parent) :
     file_menu.addAction(&action_quit);
     menu_bar.addMenu(&file_menu);
 
+    action_undo.setShortcut(QKeySequence("Ctrl+Z"));
+    edit_menu.addAction(&action_undo);
+    action_redo.setShortcut(QKeySequence("Ctrl+Y"));
+    edit_menu.addAction(&action_redo);
+    edit_menu.addSeparator();
     action_copy.setShortcut(QKeySequence("Ctrl+C"));
     edit_menu.addAction(&action_copy);
     action_cut.setShortcut(QKeySequence("Ctrl+X"));
@@ -71,12 +118,34 @@ MainWindow::MainWindow(QWidget *parent) :
     edit_menu.addSeparator();
     edit_menu.addAction(&action_copy_offset);
     edit_menu.addAction(&action_fill);
+    action_transform.setShortcut(QKeySequence("Ctrl+T"));
+    edit_menu.addAction(&action_transform);
     menu_bar.addMenu(&edit_menu);
 
+    action_find.setShortcut(QKeySequence("Ctrl+F"));
+    find_menu.addAction(&action_find);
+    action_find_next.setShortcut(QKeySequence("F3"));
+    find_menu.addAction(&action_find_next);
+    action_replace_all.setShortcut(QKeySequence("Ctrl+H"));
+    find_menu.addAction(&action_replace_all);
+    find_menu.addAction(&action_build_index);
+    action_find_in_files.setShortcut(QKeySequence("Ctrl+Shift+F"));
+    find_menu.addAction(&action_find_in_files);
     action_goto.setShortcut(QKeySequence("Ctrl+G"));
     find_menu.addAction(&action_goto);
     menu_bar.addMenu(&find_menu);
 
+    view_menu.addAction(strings_panel.toggleViewAction());
+    view_menu.addAction(struct_panel.toggleViewAction());
+    for (int width : ROW_WIDTHS) {
+        row_width_menu.addAction(QString("%1 bytes").arg(width))->setData(width);
+    }
+    row_width_menu.addSeparator();
+    row_width_menu.addAction(&action_custom_row_width);
+    view_menu.addMenu(&row_width_menu);
+    view_menu.addAction(&action_memory_usage);
+    menu_bar.addMenu(&view_menu);
+
     setMenuBar(&menu_bar);
 
     editor_tabs.setTabsClosable(true);
@@ -85,18 +154,52 @@ MainWindow::MainWindow(QWidget *parent) :
     central_widget_layout.setMargin(0);
     central_widget.setLayout(&central_widget_layout);
     setCentralWidget(&central_widget);
+    addDockWidget(Qt::DockWidgetArea::BottomDockWidgetArea, &strings_panel);
+    strings_panel.hide();
+    addDockWidget(Qt::DockWidgetArea::RightDockWidgetArea, &struct_panel);
+    struct_panel.hide();
     setWindowTitle(tr("HexEditor"));
     resize(800, 600);
 
     // Hook up event handlers
     QObject::connect(&action_open, SIGNAL(triggered(bool)), this, SLOT(handleOpen()));
+    QObject::connect(&action_open_process, SIGNAL(triggered(bool)), this, SLOT(handleOpenProcess()));
+    QObject::connect(&action_save, SIGNAL(triggered(bool)), this, SLOT(handleSave()));
+    QObject::connect(&action_save_as, SIGNAL(triggered(bool)), this, SLOT(handleSaveAs()));
     QObject::connect(&action_quit, SIGNAL(triggered(bool)), this, SLOT(close()));
+    QObject::connect(&action_undo, SIGNAL(triggered(bool)), this, SLOT(handleUndo()));
+    QObject::connect(&action_redo, SIGNAL(triggered(bool)), this, SLOT(handleRedo()));
     QObject::connect(&action_copy, SIGNAL(triggered(bool)), this, SLOT(handleCopy()));
+    QObject::connect(&action_cut, SIGNAL(triggered(bool)), this, SLOT(handleCut()));
+    QObject::connect(&action_paste, SIGNAL(triggered(bool)), this, SLOT(handlePaste()));
+    QObject::connect(&action_paste_insert, SIGNAL(triggered(bool)), this, SLOT(handlePasteInsert()));
+    QObject::connect(&action_transform, SIGNAL(triggered(bool)), this, SLOT(handleTransform()));
+    QObject::connect(&action_find, SIGNAL(triggered(bool)), this, SLOT(handleFind()));
+    QObject::connect(&action_find_next, SIGNAL(triggered(bool)), this, SLOT(handleFindNext()));
+    QObject::connect(&action_replace_all, SIGNAL(triggered(bool)), this, SLOT(handleReplaceAll()));
+    QObject::connect(&action_build_index, SIGNAL(triggered(bool)), this, SLOT(handleBuildIndex()));
+    QObject::connect(&action_find_in_files, SIGNAL(triggered(bool)), this, SLOT(handleFindInFiles()));
+    QObject::connect(&findInFilesDialog, SIGNAL(matchActivated(QString, qint64, qint64)),
+                     this, SLOT(handleFileMatchActivated(QString, qint64, qint64)));
     QObject::connect(&action_goto, SIGNAL(triggered(bool)), this, SLOT(handleGoto()));
+    QObject::connect(&row_width_menu, SIGNAL(triggered(QAction*)), this, SLOT(handleRowWidth(QAction*)));
+    QObject::connect(&action_memory_usage, SIGNAL(triggered(bool)), this, SLOT(handleMemoryUsage()));
+    QObject::connect(&strings_panel, SIGNAL(scanRequested()), this, SLOT(handleScanStrings()));
+    QObject::connect(&strings_panel, SIGNAL(stringActivated(qint64, qint64)),
+                     this, SLOT(handleStringActivated(qint64, qint64)));
+    QObject::connect(&struct_panel, SIGNAL(applyRequested()), this, SLOT(handleApplyStruct()));
+    QObject::connect(&struct_panel, SIGNAL(fieldActivated(qint64, qint64)),
+                     this, SLOT(handleFieldActivated(qint64, qint64)));
     QObject::connect(&editor_tabs, SIGNAL(currentChanged(int)), this, SLOT(handleTabChange()));
-    QObject::connect(&editor_tabs, SIGNAL(tabCloseRequested(int)), this, SLOT(handleTabClose()));
+    QObject::connect(&editor_tabs, SIGNAL(tabCloseRequested(int)), this, SLOT(handleTabClose(int)));
+    QObject::connect(&prewarm_timer, SIGNAL(timeout()), this, SLOT(handlePrewarm()));
+    QObject::connect(&clipboard, SIGNAL(invalidated(QString)), this, SLOT(handleClipboardInvalidated(QString)));
     qApp->installEventFilter(this);
 
+    prewarm_timer.setSingleShot(true);
+    prewarm_timer.setInterval(PREWARM_DELAY);
+    restoreSession();
+
 
     // For testing
     move(QApplication::screens().at(0)->geometry().center() - rect().center());
@@ -110,7 +213,7 @@ bool MainWindow::eventFilter(QObject *obj, QEvent *in_event)
 
         if (event->modifiers() == Qt::KeyboardModifier::ControlModifier) {
             if (event->key() == Qt::Key_W) {
-                handleTabClose();
+                handleTabClose(editor_tabs.currentIndex());
                 return 1;
             }
         }
@@ -137,15 +240,191 @@ bool MainWindow::eventFilter(QObject *obj, QEvent *in_event)
     return QObject::eventFilter(obj, in_event);
 }
 
+void MainWindow::closeEvent(QCloseEvent *event)
+{
+    for (int idx = 0; idx < editor_tabs.count(); ++idx) {
+        auto hex_widget = qobject_cast<HexWidget*>(editor_tabs.widget(idx));
+        if (hex_widget && !confirmClose(hex_widget)) {
+            event->ignore();
+            return;
+        }
+    }
+
+    QVector<TabState> tabs;
+    for (int idx = 0; idx < editor_tabs.count(); ++idx) {
+        QWidget *widget = editor_tabs.widget(idx);
+        if (auto placeholder = qobject_cast<PlaceholderTab*>(widget)) {
+            tabs.append(placeholder->getState());
+        } else if (auto hex_widget = qobject_cast<HexWidget*>(widget)) {
+            // Processes don't survive a restart
+            QString path = hex_widget->getPath();
+            if (!path.isEmpty()) {
+                TabState state = { path, hex_widget->selectionPivot(),
+                                   hex_widget->cursorPos(), hex_widget->topLine(),
+                                   hex_widget->rowWidth() };
+                tabs.append(state);
+            }
+        }
+    }
+    Session::save(tabs, editor_tabs.currentIndex());
+    event->accept();
+}
+
+void MainWindow::restoreSession()
+{
+    int current;
+    auto tabs = Session::load(current);
+    if (tabs.isEmpty())
+        return;
+
+    // Adding the first tab would make it current and open it
+    editor_tabs.blockSignals(true);
+    for (auto &state : tabs) {
+        editor_tabs.addTab(new PlaceholderTab(state), QFileInfo(state.path).fileName());
+    }
+    editor_tabs.setCurrentIndex(std::min(std::max(current, 0), editor_tabs.count() - 1));
+    editor_tabs.blockSignals(false);
+    handleTabChange();
+}
+
+bool MainWindow::realizeTab(int idx)
+{
+    auto placeholder = qobject_cast<PlaceholderTab*>(editor_tabs.widget(idx));
+    if (!placeholder)
+        return true;
+
+    TabState state = placeholder->getState();
+    HexWidget *editor;
+    try {
+        editor = new HexWidget(state.path, edit_menu);
+    } catch (QString) {
+        return false;
+    }
+    QObject::connect(editor, SIGNAL(documentChanged()), this, SLOT(handleDocumentChanged()));
+    watchSource(editor);
+
+    // Swap the widgets without the tab change handlers seeing it
+    bool was_current = editor_tabs.currentIndex() == idx;
+    QString title = editor_tabs.tabText(idx);
+    editor_tabs.blockSignals(true);
+    editor_tabs.insertTab(idx, editor, title);
+    if (was_current) {
+        editor_tabs.setCurrentIndex(idx);
+    }
+    delete placeholder;
+    editor_tabs.blockSignals(false);
+
+    editor->setRowWidth(state.row_width);
+    editor->restoreView(state.pivot, state.cursor, state.top_line);
+
+    // Only sources still being indexed grow into the saved view later
+    auto compressed = qobject_cast<CompressedByteSource*>(editor->getDocument()->getBase().get());
+    if (!compressed || compressed->indexComplete()) {
+        editor->finishRestoreView();
+    }
+    return true;
+}
+
+void MainWindow::handlePrewarm()
+{
+    // Neighbours of the current tab are the most likely to be visited next,
+    // open one per timeout so the UI never stalls for long
+    int current = editor_tabs.currentIndex();
+    for (int dist = 1; dist <= PREWARM_TABS; ++dist) {
+        for (int idx : { current + dist, current - dist }) {
+            if (idx < 0 || idx >= editor_tabs.count())
+                continue;
+            if (qobject_cast<PlaceholderTab*>(editor_tabs.widget(idx))) {
+                if (!realizeTab(idx)) {
+                    // Leave broken tabs for the user to look at
+                    continue;
+                }
+                prewarm_timer.start();
+                return;
+            }
+        }
+    }
+}
+
+void MainWindow::watchSource(HexWidget *editor)
+{
+    auto compressed = qobject_cast<CompressedByteSource*>(editor->getDocument()->getBase().get());
+    if (!compressed)
+        return;
+
+    // Indexes loaded from a sidecar are complete before we get to connect
+    QObject::connect(compressed, SIGNAL(indexed()), this, SLOT(handleSourceIndexed()));
+    if (compressed->indexComplete()) {
+        reportSeekSpan(compressed);
+    }
+}
+
+void MainWindow::reportSeekSpan(CompressedByteSource *source)
+{
+    // Single block xz and single frame zstd files can only be decompressed
+    // from the start
+    if (source->seekSpan() > SLOW_SEEK_SPAN) {
+        statusBar()->showMessage(tr("%1 has few seek points, jumping around in it will be slow")
+                                 .arg(QFileInfo(source->getPath()).fileName()), 10000);
+    }
+}
+
+void MainWindow::handleSourceIndexed()
+{
+    auto source = qobject_cast<CompressedByteSource*>(sender());
+    if (!source)
+        return;
+    reportSeekSpan(source);
+
+    // Saved positions past what the file turned out to hold are lost
+    for (int idx = 0; idx < editor_tabs.count(); ++idx) {
+        auto hex_widget = qobject_cast<HexWidget*>(editor_tabs.widget(idx));
+        if (hex_widget && hex_widget->getDocument()->getBase().get() == source) {
+            hex_widget->finishRestoreView();
+        }
+    }
+}
+
+HexWidget *MainWindow::openFile(QString file_name)
+{
+    try {
+        auto editor = new HexWidget(file_name, edit_menu);
+        QObject::connect(editor, SIGNAL(documentChanged()), this, SLOT(handleDocumentChanged()));
+        watchSource(editor);
+        int new_idx = editor_tabs.addTab(editor, QFileInfo(file_name).fileName());
+        editor_tabs.setCurrentIndex(new_idx);
+        return editor;
+    } catch (QString err) {
+        QMessageBox msgBox(this);
+        msgBox.setText(err);
+        msgBox.setIcon(QMessageBox::Icon::Critical);
+        msgBox.exec();
+        return nullptr;
+    }
+}
+
 void MainWindow::handleOpen()
 {
     QString file_name = QFileDialog::getOpenFileName(this);
     if (file_name == "")
         return;
 
+    openFile(file_name);
+}
+
+void MainWindow::handleOpenProcess()
+{
+    bool ok;
+    int pid = QInputDialog::getInt(this, tr("Open Process"), tr("Process ID:"),
+                                   0, 1, INT_MAX, 1, &ok);
+    if (!ok)
+        return;
+
     try {
-        auto editor = new HexWidget(file_name, edit_menu);
-        int new_idx = editor_tabs.addTab(editor, QFileInfo(file_name).fileName());
+        auto source = std::make_shared<ProcessByteSource>(pid);
+        auto editor = new HexWidget(source, edit_menu);
+        QObject::connect(editor, SIGNAL(documentChanged()), this, SLOT(handleDocumentChanged()));
+        int new_idx = editor_tabs.addTab(editor, source->processName());
         editor_tabs.setCurrentIndex(new_idx);
     } catch (QString err) {
         QMessageBox msgBox(this);
@@ -157,45 +436,423 @@ void MainWindow::handleOpen()
 
 void MainWindow::handleTabChange()
 {
-    HexWidget *hex_widget = reinterpret_cast<HexWidget*>(editor_tabs.currentWidget());
+    int idx = editor_tabs.currentIndex();
+    if (idx >= 0 && !realizeTab(idx)) {
+        QMessageBox msgBox(this);
+        msgBox.setText(QString("Cannot open %1!").arg(editor_tabs.tabText(idx)));
+        msgBox.setIcon(QMessageBox::Icon::Critical);
+        msgBox.exec();
+        delete editor_tabs.widget(idx);
+        return;
+    }
+
+    HexWidget *hex_widget = qobject_cast<HexWidget*>(editor_tabs.currentWidget());
     if (hex_widget) {
         hex_widget->setFocus(Qt::FocusReason::NoFocusReason);
     }
+    prewarm_timer.start();
+}
+
+void MainWindow::handleTabClose(int idx)
+{
+    QWidget *widget = editor_tabs.widget(idx);
+    if (!widget)
+        return;
+
+    if (auto hex_widget = qobject_cast<HexWidget*>(widget)) {
+        if (!confirmClose(hex_widget))
+            return;
+        // The template would keep the document alive
+        if (struct_panel.getDocument() == hex_widget->getDocument()) {
+            struct_panel.clear();
+        }
+    }
+    delete widget;
+}
+
+bool MainWindow::confirmClose(HexWidget *hex_widget)
+{
+    if (!hex_widget->getDocument()->modified())
+        return true;
+
+    editor_tabs.setCurrentWidget(hex_widget);
+    QString title = editor_tabs.tabText(editor_tabs.indexOf(hex_widget));
+    if (title.endsWith(" *")) {
+        title.chop(2);
+    }
+
+    QMessageBox msgBox(this);
+    msgBox.setText(QString("%1 has been modified.").arg(title));
+    msgBox.setInformativeText("Do you want to save your changes?");
+    msgBox.setIcon(QMessageBox::Icon::Question);
+    msgBox.setStandardButtons(QMessageBox::StandardButton::Save | QMessageBox::StandardButton::Discard
+                              | QMessageBox::StandardButton::Cancel);
+    msgBox.setDefaultButton(QMessageBox::StandardButton::Save);
+    switch (msgBox.exec()) {
+    case QMessageBox::StandardButton::Save:
+        return saveDocument(hex_widget);
+    case QMessageBox::StandardButton::Discard:
+        return true;
+    default:
+        return false;
+    }
+}
+
+bool MainWindow::canSave(HexWidget *hex_widget)
+{
+    QString err;
+    auto base = hex_widget->getDocument()->getBase();
+    auto compressed = qobject_cast<CompressedByteSource*>(base.get());
+    if (base->isVolatile()) {
+        // A process is a huge sparse address space that keeps changing
+        err = "Process memory can't be saved to a file!";
+    } else if (compressed && !compressed->indexComplete()) {
+        // Only the part decompressed so far would be written
+        err = "The file is still being decompressed, try again once it's done!";
+    } else {
+        return true;
+    }
+
+    QMessageBox msgBox(this);
+    msgBox.setText(err);
+    msgBox.setIcon(QMessageBox::Icon::Critical);
+    msgBox.exec();
+    return false;
+}
+
+bool MainWindow::saveDocument(HexWidget *hex_widget)
+{
+    if (!canSave(hex_widget))
+        return false;
+
+    // Compressed images can't be written back in place
+    QString file_name = hex_widget->getDocument()->fileName();
+    if (file_name.isEmpty()) {
+        file_name = QFileDialog::getSaveFileName(this);
+        if (file_name == "")
+            return false;
+    }
+    return saveDocument(hex_widget, file_name);
+}
+
+bool MainWindow::saveDocument(HexWidget *hex_widget, QString file_name)
+{
+    QProgressDialog progress("Saving...", "Cancel", 0, 100, this);
+    progress.setWindowModality(Qt::WindowModality::WindowModal);
+    progress.setMinimumDuration(500);
+
+    try {
+        bool saved = hex_widget->getDocument()->save(file_name,
+            [&progress](qint64 done, qint64 total) {
+                progress.setValue(total ? static_cast<int>(done * 100 / total) : 100);
+                return !progress.wasCanceled();
+            });
+        if (saved) {
+            int idx = editor_tabs.indexOf(hex_widget);
+            editor_tabs.setTabText(idx, QFileInfo(file_name).fileName());
+        }
+        return saved;
+    } catch (QString err) {
+        QMessageBox msgBox(this);
+        msgBox.setText(err);
+        msgBox.setIcon(QMessageBox::Icon::Critical);
+        msgBox.exec();
+        return false;
+    }
+}
+
+void MainWindow::handleSave()
+{
+    HexWidget *hex_widget = qobject_cast<HexWidget*>(editor_tabs.currentWidget());
+    if (hex_widget) {
+        saveDocument(hex_widget);
+    }
+}
+
+void MainWindow::handleSaveAs()
+{
+    HexWidget *hex_widget = qobject_cast<HexWidget*>(editor_tabs.currentWidget());
+    if (hex_widget && canSave(hex_widget)) {
+        QString file_name = QFileDialog::getSaveFileName(this);
+        if (file_name == "")
+            return;
+        saveDocument(hex_widget, file_name);
+    }
+}
+
+void MainWindow::handleUndo()
+{
+    HexWidget *hex_widget = qobject_cast<HexWidget*>(editor_tabs.currentWidget());
+    if (hex_widget) {
+        hex_widget->getDocument()->undo();
+    }
 }
 
-void MainWindow::handleTabClose()
+void MainWindow::handleRedo()
 {
-    HexWidget *hex_widget = reinterpret_cast<HexWidget*>(editor_tabs.currentWidget());
+    HexWidget *hex_widget = qobject_cast<HexWidget*>(editor_tabs.currentWidget());
     if (hex_widget) {
-        delete hex_widget;
+        hex_widget->getDocument()->redo();
     }
 }
 
+void MainWindow::handleDocumentChanged()
+{
+    HexWidget *hex_widget = qobject_cast<HexWidget*>(sender());
+    int idx = editor_tabs.indexOf(hex_widget);
+    if (idx < 0)
+        return;
+
+    // Mark modified documents in the tab title
+    QString title = editor_tabs.tabText(idx);
+    if (title.endsWith(" *")) {
+        title.chop(2);
+    }
+    if (hex_widget->getDocument()->modified()) {
+        title += " *";
+    }
+    editor_tabs.setTabText(idx, title);
+}
+
 void MainWindow::handleCopy()
 {
-    HexWidget *hex_widget = reinterpret_cast<HexWidget*>(editor_tabs.currentWidget());
+    HexWidget *hex_widget = qobject_cast<HexWidget*>(editor_tabs.currentWidget());
     if (hex_widget) {
-        auto bytes = hex_widget->getSelectedBytes();
-        if (!bytes.has_value())
+        auto range = hex_widget->getSelectedRange();
+        if (!range.has_value())
             return;
 
-        QString text;
-        bool first = true;
-        for (auto b : bytes.value()) {
-            if (!first) {
-                text += " ";
-            } else {
-                first = false;
+        clipboard.copy(*hex_widget->getDocument(), range->begin, range->end);
+    }
+}
+
+void MainWindow::handleCut()
+{
+    HexWidget *hex_widget = qobject_cast<HexWidget*>(editor_tabs.currentWidget());
+    if (hex_widget) {
+        auto range = hex_widget->getSelectedRange();
+        if (!range.has_value())
+            return;
+
+        clipboard.copy(*hex_widget->getDocument(), range->begin, range->end);
+        hex_widget->getDocument()->replace(range->begin, range->end - range->begin, QByteArray());
+        hex_widget->cursorToOffset(range->begin, CursorDeflect::NoDeflect);
+    }
+}
+
+void MainWindow::handleClipboardInvalidated(QString path)
+{
+    statusBar()->showMessage(tr("Clipboard cleared, %1 was modified on disk")
+                             .arg(QFileInfo(path).fileName()), 10000);
+}
+
+void MainWindow::paste(bool insert)
+{
+    HexWidget *hex_widget = qobject_cast<HexWidget*>(editor_tabs.currentWidget());
+    if (!hex_widget)
+        return;
+
+    // Prefer our own clipboard, it refers to the data instead of copying it
+    PieceTable contents;
+    if (auto table = clipboard.contents()) {
+        contents = *table;
+    } else {
+        const QMimeData *mime_data = qApp->clipboard()->mimeData();
+        QByteArray bytes;
+        if (mime_data && mime_data->hasFormat("application/octet-stream")) {
+            bytes = mime_data->data("application/octet-stream");
+        } else if (mime_data && mime_data->hasText()) {
+            bytes = FindDialog::parsePattern(mime_data->text(), true);
+        }
+        if (!bytes.isEmpty()) {
+            contents.append({ std::make_shared<MemoryByteSource>(bytes), 0, bytes.size() });
+        }
+    }
+    if (contents.size() == 0)
+        return;
+
+    auto document = hex_widget->getDocument();
+    auto range = hex_widget->getSelectedRange();
+    qint64 offset = range.has_value() ? range->begin : hex_widget->cursorPos();
+    qint64 len = insert ? 0 : std::min(contents.size(), document->size() - offset);
+    document->replace(offset, len, contents);
+    hex_widget->selectRange(offset, offset + contents.size());
+}
+
+void MainWindow::handlePaste()
+{
+    paste(false);
+}
+
+void MainWindow::handlePasteInsert()
+{
+    paste(true);
+}
+
+void MainWindow::handleTransform()
+{
+    HexWidget *hex_widget = qobject_cast<HexWidget*>(editor_tabs.currentWidget());
+    if (hex_widget) {
+        auto range = hex_widget->getSelectedRange();
+        if (!range.has_value())
+            return;
+
+        if (transformDialog.exec() == QDialog::Accepted) {
+            hex_widget->getDocument()->transform(range->begin, range->end, transformDialog.getTransform());
+        }
+    }
+}
+
+void MainWindow::handleFind()
+{
+    HexWidget *hex_widget = qobject_cast<HexWidget*>(editor_tabs.currentWidget());
+    if (hex_widget) {
+        if (findDialog.exec() == QDialog::Accepted) {
+            find_pattern = findDialog.getPattern();
+            handleFindNext();
+        }
+    }
+}
+
+void MainWindow::handleFindNext()
+{
+    HexWidget *hex_widget = qobject_cast<HexWidget*>(editor_tabs.currentWidget());
+    if (hex_widget) {
+        if (find_pattern.isEmpty()) {
+            handleFind();
+            return;
+        }
+
+        // Search in the background, the user can cancel long scans
+        auto document = hex_widget->getDocument();
+        QByteArray pattern = find_pattern;
+        qint64 from = hex_widget->cursorPos();
+        qint64 off = -1;
+        BackgroundJob job("Searching...", document->size() - from, this);
+        bool finished = job.run([&](const std::atomic<bool> &cancel, std::atomic<qint64> &progress) {
+            off = Searcher::findNext(*document, pattern, from, &cancel, &progress);
+        });
+        if (!finished)
+            return;
+
+        if (off >= 0) {
+            hex_widget->selectRange(off, off + find_pattern.size());
+        } else {
+            QMessageBox msgBox(this);
+            msgBox.setText("Pattern not found!");
+            msgBox.setIcon(QMessageBox::Icon::Information);
+            msgBox.exec();
+        }
+    }
+}
+
+void MainWindow::handleReplaceAll()
+{
+    HexWidget *hex_widget = qobject_cast<HexWidget*>(editor_tabs.currentWidget());
+    if (!hex_widget)
+        return;
+    if (replaceDialog.exec() != QDialog::Accepted)
+        return;
+
+    QByteArray pattern = replaceDialog.getPattern();
+    QByteArray replacement = replaceDialog.getReplacement();
+    auto document = hex_widget->getDocument();
+
+    PieceTable with;
+    if (!replacement.isEmpty()) {
+        with.append({ std::make_shared<MemoryByteSource>(replacement), 0, replacement.size() });
+    }
+
+    // Matches go straight into the new piece table as the search finds them,
+    // only the first few offsets are kept to show before touching anything
+    Replacement result(document->snapshot(), pattern.size(), with);
+    std::vector<qint64> preview_offsets;
+    BackgroundJob job("Searching...", document->size(), this);
+    bool finished = job.run([&](const std::atomic<bool> &cancel, std::atomic<qint64> &progress) {
+        Searcher::findAll(*document, pattern, [&](const std::vector<qint64> &batch) {
+            for (qint64 off : batch) {
+                if (preview_offsets.size() < 5) {
+                    preview_offsets.push_back(off);
+                }
+                result.add(off);
             }
-            text += QString::asprintf("%02X", static_cast<unsigned char>(b));
+        }, &cancel, &progress);
+    });
+    if (!finished)
+        return;
+
+    if (result.count() == 0) {
+        QMessageBox msgBox(this);
+        msgBox.setText("Pattern not found!");
+        msgBox.setIcon(QMessageBox::Icon::Information);
+        msgBox.exec();
+        return;
+    }
+
+    QString preview;
+    for (qint64 off : preview_offsets) {
+        preview += QString::asprintf("%llx\n", static_cast<unsigned long long>(off));
+    }
+    if (result.count() > 5) {
+        preview += "...";
+    }
+
+    QMessageBox msgBox(this);
+    msgBox.setText(QString("Replace %1 occurrences?").arg(result.count()));
+    msgBox.setInformativeText(preview);
+    msgBox.setIcon(QMessageBox::Icon::Question);
+    msgBox.setStandardButtons(QMessageBox::StandardButton::Ok | QMessageBox::StandardButton::Cancel);
+    if (msgBox.exec() != QMessageBox::StandardButton::Ok)
+        return;
+
+    // One undo step
+    document->replace(result);
+}
+
+void MainWindow::handleBuildIndex()
+{
+    HexWidget *hex_widget = qobject_cast<HexWidget*>(editor_tabs.currentWidget());
+    if (hex_widget) {
+        auto index = hex_widget->getDocument()->getSearchIndex();
+        if (!index) {
+            QMessageBox msgBox(this);
+            msgBox.setText("Only uncompressed files can be indexed!");
+            msgBox.setIcon(QMessageBox::Icon::Information);
+            msgBox.exec();
+            return;
         }
-        qApp->clipboard()->setText(text);
+        if (index->isReady() || index->isBuilding())
+            return;
+
+        // Searches keep scanning everything until the index is ready
+        QObject::connect(index.get(), SIGNAL(ready()), this, SLOT(handleIndexReady()));
+        index->build();
+        statusBar()->showMessage("Building search index...");
+    }
+}
+
+void MainWindow::handleIndexReady()
+{
+    statusBar()->showMessage("Search index ready", 5000);
+}
+
+void MainWindow::handleFindInFiles()
+{
+    findInFilesDialog.show();
+    findInFilesDialog.raise();
+}
+
+void MainWindow::handleFileMatchActivated(QString path, qint64 offset, qint64 length)
+{
+    HexWidget *editor = openFile(path);
+    if (editor) {
+        editor->selectRange(offset, offset + length);
     }
 }
 
 void MainWindow::handleGoto()
 {
-    HexWidget *hex_widget = reinterpret_cast<HexWidget*>(editor_tabs.currentWidget());
+    HexWidget *hex_widget = qobject_cast<HexWidget*>(editor_tabs.currentWidget());
     if (hex_widget) {
         gotoDialog.setFileSize(hex_widget->fileSize());
         if (gotoDialog.exec() == QDialog::Accepted) {
@@ -203,3 +860,81 @@ void MainWindow::handleGoto()
         }
     }
 }
+
+void MainWindow::handleRowWidth(QAction *action)
+{
+    HexWidget *hex_widget = qobject_cast<HexWidget*>(editor_tabs.currentWidget());
+    if (!hex_widget)
+        return;
+
+    int width = action->data().toInt();
+    if (action == &action_custom_row_width) {
+        bool ok;
+        width = QInputDialog::getInt(this, tr("Row Width"), tr("Bytes per row:"),
+                                     hex_widget->rowWidth(), 1, 255, 1, &ok);
+        if (!ok)
+            return;
+    }
+    hex_widget->setRowWidth(width);
+}
+
+void MainWindow::handleMemoryUsage()
+{
+    memoryDialog.show();
+    memoryDialog.raise();
+}
+
+void MainWindow::handleScanStrings()
+{
+    HexWidget *hex_widget = qobject_cast<HexWidget*>(editor_tabs.currentWidget());
+    if (hex_widget) {
+        strings_panel.scan(hex_widget->getDocument());
+    }
+}
+
+void MainWindow::handleStringActivated(qint64 offset, qint64 length)
+{
+    // Jump to the tab the strings were extracted from
+    auto document = strings_panel.getDocument();
+    for (int idx = 0; idx < editor_tabs.count(); ++idx) {
+        HexWidget *hex_widget = qobject_cast<HexWidget*>(editor_tabs.widget(idx));
+        if (document && hex_widget && hex_widget->getDocument() == document) {
+            editor_tabs.setCurrentIndex(idx);
+            hex_widget->selectRange(offset, offset + length);
+            return;
+        }
+    }
+}
+
+void MainWindow::handleApplyStruct()
+{
+    HexWidget *hex_widget = qobject_cast<HexWidget*>(editor_tabs.currentWidget());
+    if (!hex_widget)
+        return;
+
+    auto instance = struct_panel.apply(hex_widget->getDocument(), hex_widget->cursorPos());
+    if (!instance)
+        return;
+
+    // Only one template is applied at a time
+    for (int idx = 0; idx < editor_tabs.count(); ++idx) {
+        HexWidget *other = qobject_cast<HexWidget*>(editor_tabs.widget(idx));
+        if (other && other != hex_widget) {
+            other->setAnnotations(nullptr);
+        }
+    }
+    hex_widget->setAnnotations(instance);
+}
+
+void MainWindow::handleFieldActivated(qint64 offset, qint64 length)
+{
+    auto document = struct_panel.getDocument();
+    for (int idx = 0; idx < editor_tabs.count(); ++idx) {
+        HexWidget *hex_widget = qobject_cast<HexWidget*>(editor_tabs.widget(idx));
+        if (document && hex_widget && hex_widget->getDocument() == document) {
+            editor_tabs.setCurrentIndex(idx);
+            hex_widget->selectRange(offset, offset + length);
+            return;
+        }
+    }
+}
@@ -24,7 +24,19 @@
 #include <QMenuBar>
 #include <QVBoxLayout>
 #include <QTabWidget>
+#include <QTimer>
+#include "clipboard.h"
+#include "finddialog.h"
+#include "findinfilesdialog.h"
 #include "gotodialog.h"
+#include "memorydialog.h"
+#include "session.h"
+#include "stringspanel.h"
+#include "structpanel.h"
+#include "transformdialog.h"
+
+class CompressedByteSource;
+class HexWidget;
 
 class MainWindow : public QMainWindow
 {
@@ -36,41 +48,121 @@ public:
 private:
     // Menu bar
     QAction action_open;
+    QAction action_open_process;
     QAction action_save;
     QAction action_save_as;
     QAction action_quit;
     QMenu file_menu;
 
+    QAction action_undo;
+    QAction action_redo;
     QAction action_copy;
     QAction action_cut;
     QAction action_paste;
     QAction action_paste_insert;
     QAction action_copy_offset;
     QAction action_fill;
+    QAction action_transform;
     QMenu edit_menu;
 
+    QAction action_find;
+    QAction action_find_next;
+    QAction action_replace_all;
+    QAction action_build_index;
+    QAction action_find_in_files;
     QAction action_goto;
     QMenu find_menu;
 
+    QAction action_custom_row_width;
+    QMenu row_width_menu;
+    QAction action_memory_usage;
+    QMenu view_menu;
+
     QMenuBar menu_bar;
 
     // Central widget
     QWidget central_widget;
     QVBoxLayout central_widget_layout;
     QTabWidget editor_tabs;
+    StringsPanel strings_panel;
+    StructPanel struct_panel;
 
     // Dialogs
     GotoDialog gotoDialog;
+    FindDialog findDialog;
+    FindDialog replaceDialog;
+    MemoryDialog memoryDialog;
+    FindInFilesDialog findInFilesDialog;
+    TransformDialog transformDialog;
+
+    // Copied data shared between tabs
+    Clipboard clipboard;
+
+    // Opens editors for the tabs next to the current one in the background
+    QTimer prewarm_timer;
+
+    // Last pattern searched for
+    QByteArray find_pattern;
 
     // Methods
     virtual bool eventFilter(QObject *, QEvent *) override;
+    virtual void closeEvent(QCloseEvent *) override;
+    void restoreSession();
+
+    // Replace the placeholder at idx with an editor, false if it failed to open
+    bool realizeTab(int idx);
+
+    // Open fileName in a new tab, nullptr if it failed to open
+    HexWidget *openFile(QString file_name);
+
+    // Tell the user if the source of editor is slow to seek in
+    void watchSource(HexWidget *editor);
+    void reportSeekSpan(CompressedByteSource *source);
+
+    // Ask whether to save a modified document, false if the user cancelled
+    bool confirmClose(HexWidget *hex_widget);
+
+    // Check the document can be written out, telling the user if not
+    bool canSave(HexWidget *hex_widget);
+
+    // Save to the file the document came from, asking for a name if it
+    // can't be saved in place, returns false if it wasn't saved
+    bool saveDocument(HexWidget *hex_widget);
+    bool saveDocument(HexWidget *hex_widget, QString file_name);
+    void paste(bool insert);
 
 private slots:
     void handleOpen();
+    void handleOpenProcess();
     void handleTabChange();
-    void handleTabClose();
+    void handleTabClose(int idx);
+    void handlePrewarm();
+    void handleSourceIndexed();
+    void handleSave();
+    void handleSaveAs();
+    void handleUndo();
+    void handleRedo();
+    void handleDocumentChanged();
     void handleCopy();
+    void handleCut();
+    void handleClipboardInvalidated(QString path);
+    void handlePaste();
+    void handlePasteInsert();
+    void handleTransform();
+    void handleFind();
+    void handleFindNext();
+    void handleReplaceAll();
+    void handleBuildIndex();
+    void handleFindInFiles();
+    void handleFileMatchActivated(QString path, qint64 offset, qint64 length);
+    void handleIndexReady();
     void handleGoto();
+    void handleRowWidth(QAction *action);
+    void handleMemoryUsage();
+    void handleScanStrings();
+    void handleStringActivated(qint64 offset, qint64 length);
+    void handleApplyStruct();
+    void handleFieldActivated(qint64 offset, qint64 length);
 };
 
 #endif // MAINWINDOW_H
@@ -0,0 +1,137 @@
+/*
+ * HexEditor -- Qt based hex editor
+ * Copyright (C) 2021  Mate Kukri
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "memorydialog.h"
+#include "memorygovernor.h"
+#include <QHeaderView>
+#include <QMap>
+
+// How often the usage is refreshed while the dialog is shown
+static int REFRESH_INTERVAL = 1000;
+
+static qint64 MIB = 1024 * 1024;
+
+static QString formatSize(qint64 bytes)
+{
+    if (bytes < MIB)
+        return QString("%1 KiB").arg((bytes + 1023) / 1024);
+    return QString("%1 MiB").arg(static_cast<double>(bytes) / MIB, 0, 'f', 1);
+}
+
+MemoryDialog::MemoryDialog(QWidget *parent) :
+    QDialog(parent),
+    usage_tree(this),
+    total_label(this),
+    budget_box(this),
+    budget_label("Budget (MiB):", &budget_box),
+    budget_spin_box(&budget_box),
+    button_box(QDialogButtonBox::StandardButton::Close, this)
+{
+    usage_tree.setColumnCount(2);
+    usage_tree.setHeaderLabels({ tr("Document"), tr("Size") });
+    usage_tree.header()->setSectionResizeMode(0, QHeaderView::Stretch);
+    usage_tree.header()->setStretchLastSection(false);
+
+    // Setup budget box
+    budget_spin_box.setRange(64, 1024 * 1024);
+    budget_spin_box.setSingleStep(64);
+    budget_spin_box.setValue(static_cast<int>(MemoryGovernor::instance().getBudget() / MIB));
+    budget_box_layout.addWidget(&budget_label);
+    budget_box_layout.addWidget(&budget_spin_box);
+    budget_box_layout.addStretch();
+    budget_box.setLayout(&budget_box_layout);
+
+    // Setup main UI
+    layout.addWidget(&usage_tree);
+    layout.addWidget(&total_label);
+    layout.addWidget(&budget_box);
+    layout.addWidget(&button_box);
+    setLayout(&layout);
+    setWindowTitle(tr("Memory Usage"));
+    resize(500, 350);
+
+    refresh_timer.setInterval(REFRESH_INTERVAL);
+
+    // Connect event handlers
+    QObject::connect(&button_box, SIGNAL(rejected()), this, SLOT(reject()));
+    QObject::connect(&budget_spin_box, SIGNAL(valueChanged(int)), this, SLOT(handleBudgetChanged(int)));
+    QObject::connect(&refresh_timer, SIGNAL(timeout()), this, SLOT(handleRefresh()));
+}
+
+void MemoryDialog::showEvent(QShowEvent *event)
+{
+    handleRefresh();
+    refresh_timer.start();
+    QDialog::showEvent(event);
+}
+
+void MemoryDialog::hideEvent(QHideEvent *event)
+{
+    refresh_timer.stop();
+    QDialog::hideEvent(event);
+}
+
+void MemoryDialog::handleRefresh()
+{
+    auto &governor = MemoryGovernor::instance();
+
+    // Group by document, keeping the expanded state of the groups
+    QMap<QString, QVector<MemoryGovernor::Usage>> groups;
+    qint64 total = 0, unbudgeted = 0;
+    for (auto &usage : governor.usage()) {
+        groups[usage.owner].append(usage);
+        (usage.budgeted ? total : unbudgeted) += usage.bytes;
+    }
+
+    QMap<QString, bool> expanded;
+    for (int i = 0; i < usage_tree.topLevelItemCount(); ++i) {
+        auto item = usage_tree.topLevelItem(i);
+        expanded[item->text(0)] = item->isExpanded();
+    }
+
+    usage_tree.clear();
+    for (auto it = groups.begin(); it != groups.end(); ++it) {
+        auto item = new QTreeWidgetItem(&usage_tree);
+        qint64 sum = 0;
+        for (auto &usage : it.value()) {
+            auto child = new QTreeWidgetItem(item);
+            child->setText(0, usage.budgeted ? usage.kind : tr("%1 (not counted)").arg(usage.kind));
+            child->setText(1, formatSize(usage.bytes));
+            sum += usage.bytes;
+        }
+        item->setText(0, it.key());
+        item->setText(1, formatSize(sum));
+        item->setExpanded(expanded.value(it.key(), false));
+    }
+
+    QString text = QString("Total: %1 of %2").arg(formatSize(total), formatSize(governor.getBudget()));
+    if (governor.underPressure()) {
+        text += " (low on memory, using half the budget)";
+    }
+    // Only memory that can be given back is held to the budget
+    if (unbudgeted > 0) {
+        text += QString("\n%1 more that can't be released isn't counted").arg(formatSize(unbudgeted));
+    }
+    total_label.setText(text);
+}
+
+void MemoryDialog::handleBudgetChanged(int mib)
+{
+    MemoryGovernor::instance().setBudget(mib * MIB);
+    handleRefresh();
+}
@@ -0,0 +1,63 @@
+/*
+ * HexEditor -- Qt based hex editor
+ * Copyright (C) 2021  Mate Kukri
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef MEMORYDIALOG_H
+#define MEMORYDIALOG_H
+
+#include <QDialog>
+#include <QDialogButtonBox>
+#include <QHBoxLayout>
+#include <QLabel>
+#include <QSpinBox>
+#include <QTimer>
+#include <QTreeWidget>
+#include <QVBoxLayout>
+
+//
+// Memory held for every open document and the budget it is kept under
+//
+class MemoryDialog : public QDialog
+{
+    Q_OBJECT
+
+public:
+    explicit MemoryDialog(QWidget *parent = nullptr);
+
+protected:
+    void showEvent(QShowEvent *event) override;
+    void hideEvent(QHideEvent *event) override;
+
+private:
+    // UI
+    QTreeWidget usage_tree;
+    QLabel total_label;
+    QWidget budget_box;
+    QLabel budget_label;
+    QSpinBox budget_spin_box;
+    QHBoxLayout budget_box_layout;
+    QDialogButtonBox button_box;
+    QVBoxLayout layout;
+
+    QTimer refresh_timer;
+
+private slots:
+    void handleRefresh();
+    void handleBudgetChanged(int mib);
+};
+
+#endif // MEMORYDIALOG_H
@@ -0,0 +1,202 @@
+/*
+ * HexEditor -- Qt based hex editor
+ * Copyright (C) 2021  Mate Kukri
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "memorygovernor.h"
+#include <QFile>
+#include <QSettings>
+#include <algorithm>
+#include <chrono>
+
+// Budget unless configured otherwise
+static qint64 DEFAULT_BUDGET = 1024 * 1024 * 1024;
+// Interval between memory pressure checks in milliseconds
+static int PRESSURE_INTERVAL = 2000;
+// Share of time tasks stalled on memory considered pressure in percent
+static double PRESSURE_THRESHOLD = 10.0;
+
+static qint64 now()
+{
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+MemoryConsumer::MemoryConsumer()
+    : last_used(now())
+{
+}
+
+qint64 MemoryConsumer::idleTime()
+{
+    return now() - last_used;
+}
+
+void MemoryConsumer::touch()
+{
+    last_used = now();
+}
+
+MemoryGovernor &MemoryGovernor::instance()
+{
+    // Never destroyed, its timer must not outlive the application object
+    static MemoryGovernor *governor = new MemoryGovernor;
+    return *governor;
+}
+
+MemoryGovernor::MemoryGovernor()
+    : budget(QSettings().value("memory/budget", defaultBudget()).toLongLong()),
+      pressure(false),
+      pressure_path(findPressureFile())
+{
+    if (!pressure_path.isEmpty()) {
+        QObject::connect(&pressure_timer, SIGNAL(timeout()), this, SLOT(handlePressureCheck()));
+        pressure_timer.start(PRESSURE_INTERVAL);
+    }
+}
+
+qint64 MemoryGovernor::defaultBudget()
+{
+    // Stay well clear of the limit of our cgroup
+    QFile cgroup("/proc/self/cgroup");
+    if (cgroup.open(QFile::ReadOnly)) {
+        for (QByteArray line : cgroup.readAll().split('\n')) {
+            if (!line.startsWith("0::"))
+                continue;
+            QFile max_file("/sys/fs/cgroup" + QString::fromLocal8Bit(line.mid(3)) + "/memory.max");
+            if (!max_file.open(QFile::ReadOnly))
+                break;
+            bool ok;
+            qint64 max = max_file.readAll().trimmed().toLongLong(&ok);
+            if (ok) {
+                return std::min(DEFAULT_BUDGET, max / 4);
+            }
+        }
+    }
+    return DEFAULT_BUDGET;
+}
+
+QString MemoryGovernor::findPressureFile()
+{
+    // Prefer the pressure of our own cgroup (v2) over the system-wide one
+    QFile cgroup("/proc/self/cgroup");
+    if (cgroup.open(QFile::ReadOnly)) {
+        for (QByteArray line : cgroup.readAll().split('\n')) {
+            if (line.startsWith("0::")) {
+                QString path = "/sys/fs/cgroup" + QString::fromLocal8Bit(line.mid(3)) + "/memory.pressure";
+                if (QFile::exists(path))
+                    return path;
+            }
+        }
+    }
+    if (QFile::exists("/proc/pressure/memory"))
+        return "/proc/pressure/memory";
+    return QString();
+}
+
+void MemoryGovernor::add(MemoryConsumer *consumer)
+{
+    std::lock_guard<std::mutex> guard(consumers_lock);
+    consumers.push_back(consumer);
+}
+
+void MemoryGovernor::remove(MemoryConsumer *consumer)
+{
+    std::lock_guard<std::mutex> guard(consumers_lock);
+    consumers.erase(std::remove(consumers.begin(), consumers.end(), consumer), consumers.end());
+}
+
+void MemoryGovernor::setBudget(qint64 bytes)
+{
+    budget = bytes;
+    QSettings().setValue("memory/budget", bytes);
+    charge();
+}
+
+qint64 MemoryGovernor::effectiveBudget()
+{
+    qint64 limit = budget;
+    return pressure ? limit / 2 : limit;
+}
+
+void MemoryGovernor::charge()
+{
+    std::lock_guard<std::mutex> guard(consumers_lock);
+    enforce(effectiveBudget());
+}
+
+QVector<MemoryGovernor::Usage> MemoryGovernor::usage()
+{
+    std::lock_guard<std::mutex> guard(consumers_lock);
+    QVector<Usage> result;
+    for (auto consumer : consumers) {
+        result.append({ consumer->memoryOwner(), consumer->memoryKind(), consumer->memoryUsage(),
+                        consumer->reloadCost() > 0 });
+    }
+    return result;
+}
+
+void MemoryGovernor::enforce(qint64 limit)
+{
+    // Memory that can't be released would only starve everything else
+    qint64 total = 0;
+    std::vector<std::pair<double, MemoryConsumer*>> order;
+    for (auto consumer : consumers) {
+        int cost = consumer->reloadCost();
+        qint64 bytes = consumer->memoryUsage();
+        if (cost > 0 && bytes > 0) {
+            total += bytes;
+            order.emplace_back((consumer->idleTime() + 1.0) / cost, consumer);
+        }
+    }
+    if (total <= limit)
+        return;
+
+    // Long idle memory that is cheap to get back goes first
+    std::sort(order.begin(), order.end(),
+        [](const std::pair<double, MemoryConsumer*> &a, const std::pair<double, MemoryConsumer*> &b) {
+            return a.first > b.first;
+        });
+
+    for (auto &it : order) {
+        if (total <= limit)
+            break;
+        total -= it.second->releaseMemory(total - limit);
+    }
+}
+
+void MemoryGovernor::handlePressureCheck()
+{
+    QFile file(pressure_path);
+    if (!file.open(QFile::ReadOnly))
+        return;
+
+    // some avg10=1.23 avg60=0.45 avg300=0.06 total=123456
+    bool was_under_pressure = pressure;
+    for (QByteArray line : file.readAll().split('\n')) {
+        if (!line.startsWith("some "))
+            continue;
+        for (QByteArray field : line.split(' ')) {
+            if (field.startsWith("avg10=")) {
+                pressure = field.mid(6).toDouble() >= PRESSURE_THRESHOLD;
+            }
+        }
+    }
+
+    if (pressure && !was_under_pressure) {
+        charge();
+    }
+}
@@ -0,0 +1,135 @@
+/*
+ * HexEditor -- Qt based hex editor
+ * Copyright (C) 2021  Mate Kukri
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef MEMORYGOVERNOR_H
+#define MEMORYGOVERNOR_H
+
+#include <QObject>
+#include <QString>
+#include <QTimer>
+#include <QVector>
+#include <atomic>
+#include <mutex>
+#include <vector>
+
+//
+// Something holding memory on behalf of a document
+//
+// Subclasses register with the governor at the end of their constructor and
+// unregister at the start of their destructor. The governor calls back into
+// them with its own lock held, so they must never call into the governor
+// while holding a lock of their own.
+//
+class MemoryConsumer
+{
+public:
+    MemoryConsumer();
+    virtual ~MemoryConsumer() = default;
+
+    // Document the memory is held for, and what it is used for
+    virtual QString memoryOwner() = 0;
+    virtual QString memoryKind() = 0;
+
+    // Bytes currently held
+    virtual qint64 memoryUsage() = 0;
+
+    // Free at least bytes if possible, least recently used data first,
+    // returns the number of bytes freed
+    virtual qint64 releaseMemory(qint64) { return 0; }
+
+    // Relative cost of getting released memory back, 0 means the memory
+    // can't be released at all and isn't counted against the budget
+    virtual int reloadCost() { return 0; }
+
+    // Milliseconds since the memory was last used
+    qint64 idleTime();
+
+protected:
+    // Record a use of the memory
+    void touch();
+
+private:
+    std::atomic<qint64> last_used;
+};
+
+//
+// Process-wide cap on the memory held by consumers
+//
+// Whenever a consumer grows past the budget, the governor releases memory
+// across all documents, preferring consumers that have been idle the longest
+// and are the cheapest to refill. Only memory that can be released counts
+// against the budget, anything else is merely reported. The budget is halved
+// while the kernel reports memory pressure for our cgroup.
+//
+class MemoryGovernor : public QObject
+{
+    Q_OBJECT
+
+public:
+    // Created on first use, which must be on the GUI thread
+    static MemoryGovernor &instance();
+
+    void add(MemoryConsumer *consumer);
+    void remove(MemoryConsumer *consumer);
+
+    // Bytes all consumers together may hold, persisted in the settings
+    qint64 getBudget() { return budget; }
+    void setBudget(qint64 bytes);
+
+    // Is the system short on memory?
+    bool underPressure() { return pressure; }
+
+    // A consumer grew, release memory if we are over budget
+    void charge();
+
+    struct Usage {
+        QString owner;
+        QString kind;
+        qint64 bytes;
+        bool budgeted;
+    };
+
+    // Current usage of every consumer
+    QVector<Usage> usage();
+
+private:
+    MemoryGovernor();
+
+    std::vector<MemoryConsumer*> consumers;
+    std::mutex consumers_lock;
+
+    std::atomic<qint64> budget;
+    std::atomic<bool> pressure;
+
+    // Pressure stall information file of our cgroup
+    QString pressure_path;
+    QTimer pressure_timer;
+
+    // Release memory until at most limit bytes are held,
+    // consumers_lock must be held
+    void enforce(qint64 limit);
+
+    qint64 effectiveBudget();
+    static qint64 defaultBudget();
+    static QString findPressureFile();
+
+private slots:
+    void handlePressureCheck();
+};
+
+#endif // MEMORYGOVERNOR_H
@@ -0,0 +1,183 @@
+/*
+ * HexEditor -- Qt based hex editor
+ * Copyright (C) 2021  Mate Kukri
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "processsource.h"
+#include <QFile>
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cstring>
+#include <vector>
+#include <fcntl.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+// How long a snapshot of the memory map is trusted for
+static std::chrono::milliseconds MAPS_TTL(1000);
+
+ProcessByteSource::ProcessByteSource(pid_t pid)
+    : pid(pid),
+      mem_fd(-1)
+{
+    if (!loadRegions()) {
+        throw QString("Cannot read memory map of process %1").arg(pid);
+    }
+
+    // /proc/PID/mem is only used as a fallback, but opening it performs the
+    // same ptrace access check process_vm_readv would
+    mem_fd = ::open(QString("/proc/%1/mem").arg(pid).toUtf8().constData(), O_RDONLY | O_CLOEXEC);
+    if (mem_fd < 0) {
+        throw QString("Cannot access memory of process %1: %2").arg(pid).arg(strerror(errno));
+    }
+}
+
+ProcessByteSource::~ProcessByteSource()
+{
+    if (mem_fd >= 0) {
+        ::close(mem_fd);
+    }
+}
+
+QString ProcessByteSource::processName()
+{
+    QFile comm(QString("/proc/%1/comm").arg(pid));
+    QString name;
+    if (comm.open(QFile::ReadOnly)) {
+        name = QString::fromUtf8(comm.readAll()).trimmed();
+    }
+    return QString("%1 (%2)").arg(name).arg(pid);
+}
+
+bool ProcessByteSource::loadRegions()
+{
+    QFile maps(QString("/proc/%1/maps").arg(pid));
+    if (!maps.open(QFile::ReadOnly))
+        return false;
+
+    QVector<ByteRange> loaded;
+    for (auto line : maps.readAll().split('\n')) {
+        // start-end perms offset dev inode [path]
+        unsigned long long start, end;
+        char perms[5];
+        if (sscanf(line.constData(), "%llx-%llx %4s", &start, &end, perms) != 3)
+            continue;
+        // Skip unreadable mappings and the kernel's vsyscall page
+        if (perms[0] != 'r' || end > static_cast<unsigned long long>(LLONG_MAX))
+            continue;
+
+        if (!loaded.isEmpty() && loaded.last().end == static_cast<qint64>(start)) {
+            loaded.last().end = static_cast<qint64>(end);
+        } else {
+            loaded.append({ static_cast<qint64>(start), static_cast<qint64>(end) });
+        }
+    }
+
+    qint64 prev_size, new_size;
+    {
+        std::lock_guard<std::mutex> guard(regions_lock);
+        prev_size = regions.isEmpty() ? 0 : regions.last().end;
+        new_size = loaded.isEmpty() ? 0 : loaded.last().end;
+        regions = loaded;
+        regions_time = std::chrono::steady_clock::now();
+    }
+    if (new_size > prev_size) {
+        emit sizeChanged();
+    }
+    return true;
+}
+
+QVector<ByteRange> ProcessByteSource::currentRegions()
+{
+    {
+        std::lock_guard<std::mutex> guard(regions_lock);
+        if (std::chrono::steady_clock::now() - regions_time < MAPS_TTL)
+            return regions;
+    }
+
+    // Keep the last known map if the process went away
+    loadRegions();
+    std::lock_guard<std::mutex> guard(regions_lock);
+    return regions;
+}
+
+qint64 ProcessByteSource::size()
+{
+    std::lock_guard<std::mutex> guard(regions_lock);
+    return regions.isEmpty() ? 0 : regions.last().end;
+}
+
+QVector<ByteRange> ProcessByteSource::mappedRanges(qint64 begin, qint64 end)
+{
+    auto all = currentRegions();
+
+    // First region ending after begin
+    auto it = std::upper_bound(all.begin(), all.end(), begin,
+        [](qint64 val, const ByteRange &range) { return val < range.end; });
+
+    QVector<ByteRange> ranges;
+    for (; it != all.end() && it->begin < end; ++it) {
+        ranges.append({ std::max(it->begin, begin), std::min(it->end, end) });
+    }
+    return ranges;
+}
+
+qint64 ProcessByteSource::read(qint64 offset, char *buf, qint64 len)
+{
+    if (offset < 0 || len <= 0)
+        return 0;
+    qint64 total = size();
+    if (offset >= total)
+        return 0;
+    len = std::min(len, total - offset);
+
+    // Gaps read as zeroes
+    memset(buf, 0, len);
+
+    // Batch every mapped piece of the request into one syscall
+    std::vector<struct iovec> local, remote;
+    for (auto &range : mappedRanges(offset, offset + len)) {
+        size_t cnt = static_cast<size_t>(range.end - range.begin);
+        local.push_back({ buf + (range.begin - offset), cnt });
+        remote.push_back({ reinterpret_cast<void*>(range.begin), cnt });
+    }
+
+    size_t i = 0;
+    while (i < local.size()) {
+        size_t batch = std::min<size_t>(local.size() - i, IOV_MAX);
+        ssize_t got = process_vm_readv(pid, &local[i], batch, &remote[i], batch, 0);
+        if (got < 0) {
+            got = 0;
+        }
+
+        // Transfers never split an element, skip the ones that made it
+        size_t batch_end = i + batch;
+        while (i < batch_end && static_cast<size_t>(got) >= local[i].iov_len) {
+            got -= local[i].iov_len;
+            ++i;
+        }
+
+        // The element we stopped at failed, try the slow path instead
+        if (i < batch_end) {
+            pread(mem_fd, local[i].iov_base, local[i].iov_len,
+                  reinterpret_cast<off_t>(remote[i].iov_base));
+            ++i;
+        }
+    }
+
+    return len;
+}
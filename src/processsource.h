@@ -0,0 +1,63 @@
+/*
+ * HexEditor -- Qt based hex editor
+ * Copyright (C) 2021  Mate Kukri
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef PROCESSSOURCE_H
+#define PROCESSSOURCE_H
+
+#include "bytesource.h"
+#include <chrono>
+#include <sys/types.h>
+
+//
+// Address space of a live process
+//
+// Offsets are virtual addresses. Only the readable mappings listed in
+// /proc/PID/maps are ever touched, everything else reads as zeroes.
+//
+class ProcessByteSource : public ByteSource
+{
+    Q_OBJECT
+
+public:
+    explicit ProcessByteSource(pid_t pid);
+    ~ProcessByteSource() override;
+
+    using ByteSource::read;
+    qint64 size() override;
+    qint64 read(qint64 offset, char *buf, qint64 len) override;
+    QVector<ByteRange> mappedRanges(qint64 begin, qint64 end) override;
+    bool isVolatile() override { return true; }
+
+    // Name of the process for display purposes
+    QString processName();
+
+private:
+    pid_t pid;
+    int mem_fd;
+
+    // Readable mappings, sorted and with adjacent ones merged
+    QVector<ByteRange> regions;
+    std::chrono::steady_clock::time_point regions_time;
+    std::mutex regions_lock;
+
+    // Re-read /proc/PID/maps if our copy is getting old
+    QVector<ByteRange> currentRegions();
+    bool loadRegions();
+};
+
+#endif // PROCESSSOURCE_H
@@ -0,0 +1,53 @@
+/*
+ * HexEditor -- Qt based hex editor
+ * Copyright (C) 2021  Mate Kukri
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "rowlayout.h"
+
+static int ceilLog2(int val)
+{
+    int log = 0;
+    while ((1 << log) < val) {
+        ++log;
+    }
+    return log;
+}
+
+RowDivider<true>::RowDivider(int width)
+    : shift(ceilLog2(width)),
+      mask(width - 1)
+{
+}
+
+RowDivider<false>::RowDivider(int width)
+    : width(width),
+      shift(63 + ceilLog2(width))
+{
+    // magic = ceil(2^shift / width), which fits into 64 bits and is within
+    // 2^(shift - 63) of the true reciprocal, enough for exact 63-bit quotients
+    unsigned __int128 one = 1;
+    magic = static_cast<quint64>(((one << shift) + width - 1) / width);
+}
+
+RowLayout::RowLayout(int width)
+    : bytes(width),
+      split(width % 2 == 0 && width >= 8 ? width / 2 : -1),
+      pow2((width & (width - 1)) == 0),
+      pow2_divider(width),
+      divider(width)
+{
+}
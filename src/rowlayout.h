@@ -0,0 +1,98 @@
+/*
+ * HexEditor -- Qt based hex editor
+ * Copyright (C) 2021  Mate Kukri
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef ROWLAYOUT_H
+#define ROWLAYOUT_H
+
+#include <QtGlobal>
+
+//
+// Splits offsets into line and column for a given row width
+//
+// Power of two widths get away with shifts and masks, everything else
+// multiplies by a precomputed reciprocal instead of dividing.
+//
+template<bool POW2> class RowDivider;
+
+template<> class RowDivider<true>
+{
+public:
+    explicit RowDivider(int width);
+
+    qint64 line(qint64 offset) const { return offset >> shift; }
+    qint64 column(qint64 offset) const { return offset & mask; }
+
+private:
+    int shift;
+    qint64 mask;
+};
+
+template<> class RowDivider<false>
+{
+public:
+    explicit RowDivider(int width);
+
+    // Exact for every non-negative 63-bit offset
+    qint64 line(qint64 offset) const {
+        return static_cast<qint64>(static_cast<unsigned __int128>(offset) * magic >> shift);
+    }
+    qint64 column(qint64 offset) const { return offset - line(offset) * width; }
+
+private:
+    qint64 width;
+    quint64 magic;
+    int shift;
+};
+
+//
+// Geometry of the rows of a hex view
+//
+// Only cursor movement and scrolling divide, a handful of times per event.
+// Painting walks offsets line by line and never divides, so picking the
+// divider with a branch per call costs nothing worth templating the view on.
+//
+class RowLayout
+{
+public:
+    explicit RowLayout(int width = 16);
+
+    int width() const { return bytes; }
+
+    // Column after which the wide gap goes, -1 for none
+    int splitAt() const { return split; }
+
+    qint64 lineOf(qint64 offset) const {
+        return pow2 ? pow2_divider.line(offset) : divider.line(offset);
+    }
+    qint64 columnOf(qint64 offset) const {
+        return pow2 ? pow2_divider.column(offset) : divider.column(offset);
+    }
+    qint64 lineStart(qint64 line) const { return line * bytes; }
+
+    // Number of lines needed to show size bytes
+    qint64 lineCount(qint64 size) const { return lineOf(size + bytes - 1); }
+
+private:
+    int bytes;
+    int split;
+    bool pow2;
+    RowDivider<true> pow2_divider;
+    RowDivider<false> divider;
+};
+
+#endif // ROWLAYOUT_H
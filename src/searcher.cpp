@@ -0,0 +1,201 @@
+/*
+ * HexEditor -- Qt based hex editor
+ * Copyright (C) 2021  Mate Kukri
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "searcher.h"
+#include <algorithm>
+#include <cstring>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Amount of data each worker scans at once
+static qint64 SEARCH_CHUNK = 4 * 1024 * 1024;
+
+Matcher::Matcher(QByteArray pattern)
+    : pattern(pattern)
+{
+    const char *begin = this->pattern.constData();
+    const char *end = begin + this->pattern.size();
+
+    if (this->pattern.size() == 1) {
+        // memchr beats anything clever for a single byte
+        char needle = this->pattern.at(0);
+        search = [needle](const char *data, const char *data_end) {
+            auto hit = memchr(data, needle, data_end - data);
+            return hit ? static_cast<const char*>(hit) : data_end;
+        };
+    } else {
+        std::boyer_moore_horspool_searcher<const char*> bmh(begin, end);
+        search = [bmh](const char *data, const char *data_end) {
+            return std::search(data, data_end, bmh);
+        };
+    }
+}
+
+qint64 Matcher::find(const char *data, qint64 len) const
+{
+    if (pattern.isEmpty() || len < pattern.size())
+        return -1;
+
+    const char *hit = search(data, data + len);
+    return hit == data + len ? -1 : hit - data;
+}
+
+std::vector<Searcher::Chunk> Searcher::chunksOf(ByteSource &source, qint64 from, QByteArray pattern)
+{
+    // Cut every range into chunks, in file order
+    std::vector<Chunk> chunks;
+    qint64 pattern_len = pattern.size();
+    for (auto &range : source.searchRanges(pattern, from, source.size())) {
+        for (qint64 pos = range.begin; pos < range.end; pos += SEARCH_CHUNK) {
+            // Overlap chunks so matches crossing a boundary are found
+            qint64 end = std::min(range.end, pos + SEARCH_CHUNK);
+            chunks.push_back({ pos, end, std::min(range.end, end + pattern_len - 1) });
+        }
+    }
+    return chunks;
+}
+
+void Searcher::runWorkers(size_t max_threads, const std::function<void()> &worker)
+{
+    size_t nthreads = std::max(1u, std::thread::hardware_concurrency());
+    nthreads = std::min(nthreads, max_threads);
+
+    std::vector<std::thread> threads;
+    for (size_t i = 1; i < nthreads; ++i) {
+        threads.emplace_back(worker);
+    }
+    worker();
+    for (auto &thread : threads) {
+        thread.join();
+    }
+}
+
+qint64 Searcher::findNext(ByteSource &source, QByteArray pattern, qint64 from,
+                          const std::atomic<bool> *cancel,
+                          std::atomic<qint64> *progress)
+{
+    if (pattern.isEmpty())
+        return -1;
+
+    auto chunks = chunksOf(source, from, pattern);
+    Matcher matcher(pattern);
+    std::atomic<size_t> next_chunk(0);
+    std::atomic<qint64> best(-1);
+
+    runWorkers(chunks.size(), [&]() {
+        QByteArray buf;
+        for (;;) {
+            size_t idx = next_chunk++;
+            if (idx >= chunks.size() || (cancel && *cancel))
+                return;
+
+            // Chunks are handed out in order, so once anything was found
+            // every later chunk can only produce a worse result
+            qint64 cur_best = best;
+            if (cur_best >= 0 && chunks[idx].begin >= cur_best)
+                return;
+
+            qint64 len = chunks[idx].read_end - chunks[idx].begin;
+            buf.resize(static_cast<int>(len));
+            qint64 cnt = source.read(chunks[idx].begin, buf.data(), len);
+            qint64 hit = matcher.find(buf.constData(), cnt);
+            if (progress)
+                *progress += chunks[idx].end - chunks[idx].begin;
+            if (hit < 0)
+                continue;
+
+            qint64 off = chunks[idx].begin + hit;
+            while (cur_best < 0 || off < cur_best) {
+                if (best.compare_exchange_weak(cur_best, off))
+                    break;
+            }
+        }
+    });
+
+    if (cancel && *cancel)
+        return -1;
+    return best;
+}
+
+void Searcher::findAll(ByteSource &source, QByteArray pattern,
+                       const std::function<void(const std::vector<qint64> &)> &found,
+                       const std::atomic<bool> *cancel,
+                       std::atomic<qint64> *progress)
+{
+    if (pattern.isEmpty())
+        return;
+
+    auto chunks = chunksOf(source, 0, pattern);
+    std::vector<std::vector<qint64>> chunk_matches(chunks.size());
+    std::vector<bool> chunk_done(chunks.size());
+    Matcher matcher(pattern);
+    std::atomic<size_t> next_chunk(0);
+
+    // Chunks finish out of order, matches are handed on once every chunk
+    // before them is done, keeping the leftmost of overlapping matches
+    std::mutex found_lock;
+    size_t next_found = 0;
+    qint64 next_free = 0;
+
+    runWorkers(chunks.size(), [&]() {
+        QByteArray buf;
+        for (;;) {
+            size_t idx = next_chunk++;
+            if (idx >= chunks.size() || (cancel && *cancel))
+                return;
+
+            const Chunk &chunk = chunks[idx];
+            qint64 len = chunk.read_end - chunk.begin;
+            buf.resize(static_cast<int>(len));
+            qint64 cnt = source.read(chunk.begin, buf.data(), len);
+
+            // Collect every candidate, overlaps are resolved in order later
+            std::vector<qint64> hits;
+            qint64 pos = 0;
+            for (;;) {
+                qint64 hit = matcher.find(buf.constData() + pos, cnt - pos);
+                if (hit < 0 || chunk.begin + pos + hit >= chunk.end)
+                    break;
+                hits.push_back(chunk.begin + pos + hit);
+                pos += hit + 1;
+            }
+
+            if (progress) {
+                *progress += chunk.end - chunk.begin;
+            }
+
+            std::lock_guard<std::mutex> guard(found_lock);
+            chunk_matches[idx].swap(hits);
+            chunk_done[idx] = true;
+            for (; next_found < chunks.size() && chunk_done[next_found]; ++next_found) {
+                std::vector<qint64> batch;
+                for (qint64 off : chunk_matches[next_found]) {
+                    if (off >= next_free) {
+                        batch.push_back(off);
+                        next_free = off + pattern.size();
+                    }
+                }
+                std::vector<qint64>().swap(chunk_matches[next_found]);
+                if (!batch.empty() && !(cancel && *cancel)) {
+                    found(batch);
+                }
+            }
+        }
+    });
+}
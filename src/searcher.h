@@ -0,0 +1,82 @@
+/*
+ * HexEditor -- Qt based hex editor
+ * Copyright (C) 2021  Mate Kukri
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef SEARCHER_H
+#define SEARCHER_H
+
+#include <QByteArray>
+#include <atomic>
+#include <functional>
+#include <vector>
+#include "bytesource.h"
+
+//
+// Finds a fixed byte pattern in memory
+//
+class Matcher
+{
+public:
+    explicit Matcher(QByteArray pattern);
+
+    // Offset of the first match in data, or -1 if there is none
+    qint64 find(const char *data, qint64 len) const;
+
+    int length() const { return pattern.size(); }
+
+private:
+    QByteArray pattern;
+    std::function<const char *(const char *, const char *)> search;
+};
+
+//
+// Parallel search over a ByteSource
+//
+// The ranges of the source that may contain the pattern are cut into chunks
+// which are scanned by a pool of threads, so sparse sources search each
+// region concurrently and indexed documents only scan candidate blocks.
+//
+class Searcher
+{
+public:
+    // Find the first occurrence of pattern at or after from, -1 if none,
+    // adding the number of bytes scanned to progress as the search goes
+    static qint64 findNext(ByteSource &source, QByteArray pattern, qint64 from,
+                           const std::atomic<bool> *cancel = nullptr,
+                           std::atomic<qint64> *progress = nullptr);
+
+    // Find every non-overlapping occurrence of pattern, passing them to
+    // found in order a batch at a time (never concurrently) and adding the
+    // number of bytes scanned to progress as the search goes
+    static void findAll(ByteSource &source, QByteArray pattern,
+                        const std::function<void(const std::vector<qint64> &batch)> &found,
+                        const std::atomic<bool> *cancel = nullptr,
+                        std::atomic<qint64> *progress = nullptr);
+
+private:
+    struct Chunk {
+        // Matches must start in [begin, end), data is read up to read_end
+        qint64 begin, end, read_end;
+    };
+
+    static std::vector<Chunk> chunksOf(ByteSource &source, qint64 from, QByteArray pattern);
+
+    // Run worker on every thread of the pool until it returns
+    static void runWorkers(size_t max_threads, const std::function<void()> &worker);
+};
+
+#endif // SEARCHER_H
@@ -0,0 +1,483 @@
+/*
+ * HexEditor -- Qt based hex editor
+ * Copyright (C) 2021  Mate Kukri
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include "searchindex.h"
+#include <QDataStream>
+#include <QDateTime>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QtEndian>
+#include <algorithm>
+#include <cstring>
+#include <functional>
+#include <unordered_map>
+#include <unistd.h>
+
+// Granularity of the index
+static qint64 INDEX_BLOCK = 16 * 1024;
+// Blocks per segment, the unit kept when the file changes
+static qint64 SEGMENT_BLOCKS = 1024;
+// Trigrams are hashed into 2^BUCKET_BITS buckets of one bit per block, so
+// the sidecar takes BUCKETS / (8 * INDEX_BLOCK) = 1/8 of the file
+static int BUCKET_BITS = 14;
+static qint64 BUCKETS = 1 << BUCKET_BITS;
+// Bytes of the bitmap of one bucket in one segment
+static qint64 BITMAP_BYTES = SEGMENT_BLOCKS / 8;
+// Segments indexed before their bitmaps are written out, one write per bucket
+static qint64 SEGMENT_GROUP = 16;
+// Most trigrams of a pattern looked up per search
+static size_t QUERY_GRAMS = 16;
+
+static QString SIDECAR_SUFFIX(".hexgram");
+static quint32 INDEX_MAGIC = 0x48584731;
+static quint32 INDEX_VERSION = 3;
+
+static inline quint32 gramAt(const unsigned char *data)
+{
+    return (data[0] << 16) | (data[1] << 8) | data[2];
+}
+
+static inline quint32 bucketOf(quint32 gram)
+{
+    return (gram * 0x9e3779b1u) >> (32 - BUCKET_BITS);
+}
+
+// Hash telling segments apart, not meant to withstand malicious input
+static quint64 hashBytes(const char *data, qint64 len)
+{
+    quint64 hash = 0xcbf29ce484222325ull ^ static_cast<quint64>(len);
+    qint64 i = 0;
+    for (; i + 8 <= len; i += 8) {
+        quint64 word;
+        memcpy(&word, data + i, 8);
+        hash = (hash ^ word) * 0x100000001b3ull;
+        hash ^= hash >> 29;
+    }
+    for (; i < len; ++i) {
+        hash = (hash ^ static_cast<unsigned char>(data[i])) * 0x100000001b3ull;
+    }
+    hash = (hash ^ (hash >> 33)) * 0xff51afd7ed558ccdull;
+    return hash ^ (hash >> 33);
+}
+
+// Run fn(idx) for every idx in [0, count) on a pool of threads
+static void parallelFor(qint64 count, const std::function<void(qint64)> &fn)
+{
+    std::atomic<qint64> next(0);
+    auto worker = [&]() {
+        for (qint64 idx = next++; idx < count; idx = next++) {
+            fn(idx);
+        }
+    };
+
+    size_t nthreads = std::min<size_t>(std::max(1u, std::thread::hardware_concurrency()), count);
+    std::vector<std::thread> threads;
+    for (size_t i = 1; i < nthreads; ++i) {
+        threads.emplace_back(worker);
+    }
+    worker();
+    for (auto &thread : threads) {
+        thread.join();
+    }
+}
+
+// Read len bytes at pos of fd, returns the number of bytes read
+static qint64 preadFully(int fd, void *buf, qint64 len, qint64 pos)
+{
+    // pread doesn't move a shared file position, so searches don't serialize
+    qint64 done = 0;
+    while (done < len) {
+        ssize_t cnt = pread(fd, static_cast<char*>(buf) + done, len - done, pos + done);
+        if (cnt <= 0)
+            break;
+        done += cnt;
+    }
+    return done;
+}
+
+SearchIndex::SearchIndex(std::shared_ptr<ByteSource> source)
+    : source(source),
+      file_name(source->fileName()),
+      file_size(0),
+      segment_count(0),
+      data_pos(0),
+      ready_flag(false),
+      building(false),
+      cancel(false),
+      bytes_indexed(0),
+      worker_running(false),
+      build_requested(false),
+      load_pending(true)
+{
+    if (!canIndex(*source))
+        return;
+
+    // Documents open before the sidecar is even looked at
+    std::lock_guard<std::mutex> guard(worker_lock);
+    startWorker();
+}
+
+SearchIndex::~SearchIndex()
+{
+    cancel = true;
+    if (worker.joinable()) {
+        worker.join();
+    }
+}
+
+bool SearchIndex::canIndex(ByteSource &source)
+{
+    return !source.fileName().isEmpty() && !source.isVolatile();
+}
+
+void SearchIndex::build()
+{
+    if (ready_flag || !canIndex(*source))
+        return;
+
+    std::lock_guard<std::mutex> guard(worker_lock);
+    build_requested = true;
+    if (!worker_running) {
+        startWorker();
+    }
+}
+
+void SearchIndex::startWorker()
+{
+    // A worker that isn't running anymore is about to return, if not gone
+    if (worker.joinable()) {
+        worker.join();
+    }
+    worker_running = true;
+    worker = std::thread(&SearchIndex::runWorker, this);
+}
+
+void SearchIndex::runWorker()
+{
+    if (load_pending) {
+        load_pending = false;
+        bool stale;
+        if (load(stale)) {
+            ready_flag = true;
+            emit ready();
+        } else if (stale) {
+            // Indexed before, the user expects it to stay that way
+            std::lock_guard<std::mutex> guard(worker_lock);
+            build_requested = true;
+        }
+    }
+
+    for (;;) {
+        {
+            std::lock_guard<std::mutex> guard(worker_lock);
+            if (ready_flag || cancel || !build_requested) {
+                worker_running = false;
+                return;
+            }
+            build_requested = false;
+        }
+        building = true;
+        buildIndex();
+        building = false;
+    }
+}
+
+bool SearchIndex::readLayout(QFile &file, Layout &layout)
+{
+    QDataStream stream(&file);
+    quint32 magic, version, bucket_count;
+    qint64 block_size, segment_blocks, count;
+    file.seek(0);
+    stream >> magic >> version >> layout.size >> layout.mtime
+           >> block_size >> segment_blocks >> bucket_count >> count;
+    qint64 segment_bytes = INDEX_BLOCK * SEGMENT_BLOCKS;
+    if (stream.status() != QDataStream::Ok
+            || magic != INDEX_MAGIC
+            || version != INDEX_VERSION
+            || block_size != INDEX_BLOCK
+            || segment_blocks != SEGMENT_BLOCKS
+            || bucket_count != BUCKETS
+            || layout.size < 0
+            || count != (layout.size + segment_bytes - 1) / segment_bytes
+            || file.size() - file.pos() < count * 8)
+        return false;
+
+    // Segment hashes, then the bitmaps
+    QByteArray table = file.read(count * 8);
+    if (table.size() != count * 8)
+        return false;
+    layout.hashes.resize(count);
+    for (qint64 idx = 0; idx < count; ++idx) {
+        layout.hashes[idx] = qFromBigEndian<quint64>(table.constData() + idx * 8);
+    }
+    layout.data_pos = file.pos();
+    return file.size() == layout.data_pos + BUCKETS * count * BITMAP_BYTES;
+}
+
+bool SearchIndex::load(bool &stale)
+{
+    stale = false;
+    bitmaps.setFileName(ByteSource::sidecarPath(file_name, SIDECAR_SUFFIX));
+    if (!bitmaps.open(QFile::ReadOnly))
+        return false;
+
+    Layout layout;
+    if (!readLayout(bitmaps, layout)) {
+        bitmaps.close();
+        return false;
+    }
+
+    // The index is only valid for the exact file it was built from
+    QFileInfo info(file_name);
+    if (layout.size != info.size() || layout.mtime != info.lastModified().toMSecsSinceEpoch()) {
+        stale = true;
+        bitmaps.close();
+        return false;
+    }
+    file_size = layout.size;
+    segment_count = layout.hashes.size();
+    data_pos = layout.data_pos;
+    return true;
+}
+
+void SearchIndex::indexSegment(const char *data, qint64 len, qint64 covered,
+                               unsigned char *group, qint64 stride, qint64 slot)
+{
+    // Buckets of the trigrams of every block in parallel, trigrams starting
+    // at the end of a block belong to it
+    qint64 block_count = (covered + INDEX_BLOCK - 1) / INDEX_BLOCK;
+    qint64 words = BUCKETS / 64;
+    std::vector<quint64> block_buckets(block_count * words, 0);
+    parallelFor(block_count, [&](qint64 idx) {
+        quint64 *set = block_buckets.data() + idx * words;
+        qint64 offset = idx * INDEX_BLOCK;
+        qint64 block_len = std::min(INDEX_BLOCK + 2, len - offset);
+        auto block = reinterpret_cast<const unsigned char*>(data + offset);
+        for (qint64 i = 0; i + 2 < block_len; ++i) {
+            quint32 bucket = bucketOf(gramAt(block + i));
+            set[bucket >> 6] |= 1ull << (bucket & 63);
+        }
+    });
+
+    // Turn them around into the bitmaps of the buckets, every task owns the
+    // bitmaps of 64 buckets
+    parallelFor(words, [&](qint64 word) {
+        for (qint64 block = 0; block < block_count; ++block) {
+            quint64 bits = block_buckets[block * words + word];
+            for (int bit = 0; bits; ++bit, bits >>= 1) {
+                if (!(bits & 1))
+                    continue;
+                qint64 bucket = word * 64 + bit;
+                unsigned char *bitmap = group + (bucket * stride + slot) * BITMAP_BYTES;
+                bitmap[block >> 3] |= 1 << (block & 7);
+            }
+        }
+    });
+}
+
+void SearchIndex::buildIndex()
+{
+    QFileInfo info(file_name);
+    QString sidecar_path = ByteSource::sidecarPath(file_name, SIDECAR_SUFFIX);
+    qint64 size = source->size();
+    qint64 segment_bytes = INDEX_BLOCK * SEGMENT_BLOCKS;
+    qint64 count = (size + segment_bytes - 1) / segment_bytes;
+
+    // Segments of an earlier sidecar whose bitmaps can be copied
+    QFile old_sidecar(sidecar_path);
+    Layout old;
+    std::unordered_map<quint64, qint64> reusable;
+    if (old_sidecar.open(QFile::ReadOnly) && readLayout(old_sidecar, old)) {
+        for (qint64 idx = 0; idx < static_cast<qint64>(old.hashes.size()); ++idx) {
+            reusable[old.hashes[idx]] = idx;
+        }
+    }
+    qint64 old_count = old.hashes.size();
+
+    QSaveFile sidecar(sidecar_path);
+    if (!sidecar.open(QFile::WriteOnly))
+        return;
+
+    // Hashes are filled in as segments are read
+    QDataStream stream(&sidecar);
+    stream << INDEX_MAGIC << INDEX_VERSION
+           << static_cast<qint64>(info.size())
+           << static_cast<qint64>(info.lastModified().toMSecsSinceEpoch())
+           << INDEX_BLOCK << SEGMENT_BLOCKS
+           << static_cast<quint32>(BUCKETS) << count;
+    qint64 table_pos = sidecar.pos();
+    QByteArray table(static_cast<int>(count * 8), 0);
+    stream.writeRawData(table.constData(), table.size());
+    qint64 bitmaps_pos = sidecar.pos();
+
+    qint64 stride = std::min(SEGMENT_GROUP, count);
+    std::vector<unsigned char> group(BUCKETS * stride * BITMAP_BYTES);
+    QByteArray data;
+    for (qint64 first = 0; first < count; first += stride) {
+        qint64 group_len = std::min(stride, count - first);
+        std::fill(group.begin(), group.end(), 0);
+
+        // Slots of the group filled from the old sidecar, and where from
+        std::vector<std::pair<qint64, qint64>> copies;
+        for (qint64 slot = 0; slot < group_len; ++slot) {
+            qint64 begin = (first + slot) * segment_bytes;
+            qint64 covered = std::min(segment_bytes, size - begin);
+            qint64 len = std::min(segment_bytes + 2, size - begin);
+            data.resize(static_cast<int>(len));
+            if (source->read(begin, data.data(), len) != len)
+                return;
+
+            quint64 hash = hashBytes(data.constData(), len);
+            qToBigEndian<quint64>(hash, table.data() + (first + slot) * 8);
+            auto it = reusable.find(hash);
+            if (it != reusable.end()) {
+                copies.push_back({ slot, it->second });
+            } else {
+                indexSegment(data.constData(), len, covered, group.data(), stride, slot);
+            }
+            if (cancel)
+                return;
+            bytes_indexed = begin + covered;
+        }
+
+        // Segments side by side in both sidecars, usually all of them, are
+        // copied with one read per bucket
+        for (size_t i = 0; i < copies.size();) {
+            size_t j = i + 1;
+            while (j < copies.size() && copies[j].first == copies[j - 1].first + 1
+                    && copies[j].second == copies[j - 1].second + 1) {
+                ++j;
+            }
+            qint64 run_bytes = (j - i) * BITMAP_BYTES;
+            for (qint64 bucket = 0; bucket < BUCKETS; ++bucket) {
+                qint64 from = old.data_pos + (bucket * old_count + copies[i].second) * BITMAP_BYTES;
+                unsigned char *to = group.data() + (bucket * stride + copies[i].first) * BITMAP_BYTES;
+                if (preadFully(old_sidecar.handle(), to, run_bytes, from) != run_bytes)
+                    return;
+            }
+            i = j;
+        }
+
+        for (qint64 bucket = 0; bucket < BUCKETS; ++bucket) {
+            qint64 pos = bitmaps_pos + (bucket * count + first) * BITMAP_BYTES;
+            qint64 len = group_len * BITMAP_BYTES;
+            auto bytes = reinterpret_cast<const char*>(group.data() + bucket * stride * BITMAP_BYTES);
+            if (!sidecar.seek(pos) || sidecar.write(bytes, len) != len)
+                return;
+        }
+    }
+
+    if (!sidecar.seek(table_pos) || sidecar.write(table) != table.size())
+        return;
+    old_sidecar.close();
+    if (stream.status() != QDataStream::Ok || !sidecar.commit())
+        return;
+
+    // Queries always go through the sidecar
+    bool stale;
+    if (load(stale)) {
+        ready_flag = true;
+        emit ready();
+    }
+}
+
+QByteArray SearchIndex::readAt(qint64 pos, qint64 len)
+{
+    QByteArray bytes(static_cast<int>(len), 0);
+    bytes.resize(static_cast<int>(preadFully(bitmaps.handle(), bytes.data(), len, pos)));
+    return bytes;
+}
+
+bool SearchIndex::candidates(QByteArray pattern, QVector<ByteRange> &ranges)
+{
+    if (!ready_flag || pattern.size() < 3)
+        return false;
+
+    // A match starting in block b has all its trigrams starting in b or b + 1
+    // as long as they start less than a block into the pattern
+    auto data = reinterpret_cast<const unsigned char*>(pattern.constData());
+    qint64 last_gram = std::min<qint64>(pattern.size() - 3, INDEX_BLOCK - 1);
+    std::vector<quint32> buckets;
+    for (qint64 i = 0; i <= last_gram; ++i) {
+        quint32 bucket = bucketOf(gramAt(data + i));
+        if (std::find(buckets.begin(), buckets.end(), bucket) == buckets.end()) {
+            buckets.push_back(bucket);
+        }
+        if (buckets.size() >= 4 * QUERY_GRAMS)
+            break;
+    }
+    // Trigrams spread over the pattern overlap the least
+    if (buckets.size() > QUERY_GRAMS) {
+        std::vector<quint32> spread;
+        for (size_t i = 0; i < QUERY_GRAMS; ++i) {
+            spread.push_back(buckets[i * buckets.size() / QUERY_GRAMS]);
+        }
+        buckets = std::move(spread);
+    }
+
+    // Candidate blocks of every segment, only the span of segments still
+    // holding any is read for the next trigram
+    qint64 words = SEGMENT_BLOCKS / 64;
+    std::vector<quint64> result(segment_count * words, 0);
+    qint64 lo = 0, hi = segment_count;
+    bool first = true;
+    for (quint32 bucket : buckets) {
+        if (lo >= hi)
+            break;
+
+        // One segment more for the blocks following the last ones
+        qint64 read_hi = std::min(hi + 1, segment_count);
+        QByteArray row = readAt(data_pos + (bucket * segment_count + lo) * BITMAP_BYTES,
+                                (read_hi - lo) * BITMAP_BYTES);
+        if (row.size() != (read_hi - lo) * BITMAP_BYTES)
+            return false;
+
+        qint64 row_words = (read_hi - lo) * words;
+        auto word = [&row](qint64 idx) { return qFromLittleEndian<quint64>(row.constData() + idx * 8); };
+        qint64 new_lo = hi, new_hi = lo;
+        for (qint64 idx = 0; idx < (hi - lo) * words; ++idx) {
+            quint64 bits = word(idx);
+            quint64 next = idx + 1 < row_words ? word(idx + 1) : 0;
+            quint64 mask = bits | (bits >> 1) | (next << 63);
+            quint64 &res = result[lo * words + idx];
+            res = first ? mask : res & mask;
+            if (res) {
+                new_lo = std::min(new_lo, lo + idx / words);
+                new_hi = lo + idx / words + 1;
+            }
+        }
+        lo = new_lo;
+        hi = new_hi;
+        first = false;
+    }
+
+    ranges.clear();
+    for (qint64 idx = lo * words; idx < hi * words; ++idx) {
+        for (int bit = 0; bit < 64; ++bit) {
+            if (!(result[idx] >> bit & 1))
+                continue;
+            qint64 begin = (idx * 64 + bit) * INDEX_BLOCK;
+            qint64 end = std::min(begin + INDEX_BLOCK, file_size);
+            if (!ranges.isEmpty() && ranges.last().end == begin) {
+                ranges.last().end = end;
+            } else if (begin < end) {
+                ranges.append({ begin, end });
+            }
+        }
+    }
+    return true;
+}
@@ -0,0 +1,129 @@
+/*
+ * HexEditor -- Qt based hex editor
+ * Copyright (C) 2021  Mate Kukri
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef SEARCHINDEX_H
+#define SEARCHINDEX_H
+
+#include "bytesource.h"
+#include <QFile>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+//
+// Trigram index of the blocks of a file
+//
+// Trigrams are hashed into a fixed number of buckets, and every bucket has
+// a bitmap with one bit per block telling whether any of its trigrams occur
+// in the block. Searches only scan the blocks whose bits are set for every
+// trigram of the pattern. The index takes the same fraction of the file no
+// matter what the data looks like, data with more distinct trigrams merely
+// rules out fewer blocks.
+//
+// The index is kept in a sidecar file, with the bitmaps of a bucket for the
+// whole file next to each other, so a search reads one run of bytes per
+// trigram however large the file is. The file is indexed in segments
+// identified by a hash of their contents: when the file changed since the
+// sidecar was written the index is brought up to date in the background,
+// copying the bitmaps of the segments that didn't change from the old
+// sidecar instead of indexing them again.
+//
+class SearchIndex : public QObject
+{
+    Q_OBJECT
+
+public:
+    // Start loading the sidecar of source in the background, and updating
+    // it if the file changed since
+    explicit SearchIndex(std::shared_ptr<ByteSource> source);
+    ~SearchIndex() override;
+
+    // Only sources backed by files that don't change can be indexed
+    static bool canIndex(ByteSource &source);
+
+    bool isReady() { return ready_flag; }
+    bool isBuilding() { return building; }
+
+    // Build the index in the background, once the sidecar is found missing
+    // if it is still being loaded
+    void build();
+
+    // Number of bytes indexed so far
+    qint64 progress() { return bytes_indexed; }
+
+    // Ranges of the file matches of pattern can start in, returns false if
+    // the index can't narrow down the search
+    bool candidates(QByteArray pattern, QVector<ByteRange> &ranges);
+
+signals:
+    // Emitted from the background thread once the index can be used
+    void ready();
+
+private:
+    // Where things are in a sidecar
+    struct Layout {
+        // Size and mtime of the file it was built for
+        qint64 size;
+        qint64 mtime;
+        // Hash of the bytes of every segment
+        std::vector<quint64> hashes;
+        qint64 data_pos;
+    };
+
+    std::shared_ptr<ByteSource> source;
+    QString file_name;
+
+    // Layout of the loaded sidecar
+    qint64 file_size;
+    qint64 segment_count;
+    qint64 data_pos;
+    QFile bitmaps;
+
+    std::atomic<bool> ready_flag;
+    std::atomic<bool> building;
+    std::atomic<bool> cancel;
+    std::atomic<qint64> bytes_indexed;
+
+    // The worker either loads the sidecar or builds it, build requests
+    // made while it runs are picked up before it exits
+    std::mutex worker_lock;
+    std::thread worker;
+    bool worker_running;
+    bool build_requested;
+    bool load_pending;
+
+    void startWorker();
+    void runWorker();
+
+    // Read the layout of a sidecar, returns false if it is unusable
+    static bool readLayout(QFile &file, Layout &layout);
+
+    // Load the sidecar, sets stale if it exists but the file changed since
+    bool load(bool &stale);
+    void buildIndex();
+
+    // Set the bits of the blocks of a segment in the bitmaps of a group of
+    // segments, bucket after bucket with stride bitmaps each
+    void indexSegment(const char *data, qint64 len, qint64 covered,
+                      unsigned char *group, qint64 stride, qint64 slot);
+
+    QByteArray readAt(qint64 pos, qint64 len);
+};
+
+#endif // SEARCHINDEX_H
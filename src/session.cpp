@@ -0,0 +1,74 @@
+/*
+ * HexEditor -- Qt based hex editor
+ * Copyright (C) 2021  Mate Kukri
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "session.h"
+#include <QSettings>
+
+PlaceholderTab::PlaceholderTab(TabState state, QWidget *parent) :
+    QWidget(parent),
+    state(state),
+    label(QString("Loading %1...").arg(state.path), this)
+{
+    label.setAlignment(Qt::AlignmentFlag::AlignCenter);
+    layout.addWidget(&label);
+    setLayout(&layout);
+}
+
+void Session::save(const QVector<TabState> &tabs, int current)
+{
+    QSettings settings;
+    settings.beginGroup("session");
+    settings.remove("");
+    settings.setValue("current", current);
+    settings.beginWriteArray("tabs", tabs.size());
+    for (int i = 0; i < tabs.size(); ++i) {
+        settings.setArrayIndex(i);
+        settings.setValue("path", tabs[i].path);
+        settings.setValue("pivot", tabs[i].pivot);
+        settings.setValue("cursor", tabs[i].cursor);
+        settings.setValue("top_line", tabs[i].top_line);
+        settings.setValue("row_width", tabs[i].row_width);
+    }
+    settings.endArray();
+    settings.endGroup();
+}
+
+QVector<TabState> Session::load(int &current)
+{
+    QSettings settings;
+    settings.beginGroup("session");
+    current = settings.value("current", 0).toInt();
+
+    QVector<TabState> tabs;
+    int count = settings.beginReadArray("tabs");
+    for (int i = 0; i < count; ++i) {
+        settings.setArrayIndex(i);
+        TabState state;
+        state.path = settings.value("path").toString();
+        state.pivot = settings.value("pivot", 0).toLongLong();
+        state.cursor = settings.value("cursor", 0).toLongLong();
+        state.top_line = settings.value("top_line", 0).toLongLong();
+        state.row_width = settings.value("row_width", 16).toInt();
+        if (!state.path.isEmpty()) {
+            tabs.append(state);
+        }
+    }
+    settings.endArray();
+    settings.endGroup();
+    return tabs;
+}
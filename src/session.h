@@ -0,0 +1,72 @@
+/*
+ * HexEditor -- Qt based hex editor
+ * Copyright (C) 2021  Mate Kukri
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef SESSION_H
+#define SESSION_H
+
+#include <QLabel>
+#include <QString>
+#include <QVBoxLayout>
+#include <QVector>
+#include <QWidget>
+
+//
+// Saved state of an editor tab
+//
+struct TabState
+{
+    QString path;
+    qint64 pivot;
+    qint64 cursor;
+    qint64 top_line;
+    int row_width;
+};
+
+//
+// Tab standing in for an editor until it is first shown
+//
+// Nothing is opened or read for a placeholder, so restoring a large session
+// costs next to nothing.
+//
+class PlaceholderTab : public QWidget
+{
+    Q_OBJECT
+
+public:
+    explicit PlaceholderTab(TabState state, QWidget *parent = nullptr);
+    TabState getState() { return state; }
+
+private:
+    TabState state;
+
+    // UI
+    QLabel label;
+    QVBoxLayout layout;
+};
+
+//
+// Set of tabs open when the editor was last closed
+//
+class Session
+{
+public:
+    static void save(const QVector<TabState> &tabs, int current);
+    static QVector<TabState> load(int &current);
+};
+
+#endif // SESSION_H
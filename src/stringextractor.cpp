@@ -0,0 +1,227 @@
+/*
+ * HexEditor -- Qt based hex editor
+ * Copyright (C) 2021  Mate Kukri
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "stringextractor.h"
+#include <algorithm>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// Amount of data each worker scans at once
+static qint64 STRINGS_CHUNK = 4 * 1024 * 1024;
+
+// Block size used to follow a string past the end of its chunk
+static qint64 EXTEND_BLOCK = 64 * 1024;
+
+// Number of characters of each string kept for display
+static int MAX_TEXT = 256;
+
+static inline bool isPrintable(unsigned char c)
+{
+    return (c >= 0x20 && c < 0x7f) || c == '\t';
+}
+
+// Set out[i] to 1 for every printable byte of data, 0 otherwise
+static void classify(const char *data, qint64 len, unsigned char *out)
+{
+    qint64 i = 0;
+#ifdef __SSE2__
+    // Bytes >= 0x80 are negative as signed chars, so the two signed
+    // compares below exclude them as well
+    const __m128i lo = _mm_set1_epi8(0x1f);
+    const __m128i hi = _mm_set1_epi8(0x7f);
+    const __m128i tab = _mm_set1_epi8('\t');
+    const __m128i one = _mm_set1_epi8(1);
+    for (; i + 16 <= len; i += 16) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+        __m128i in_range = _mm_and_si128(_mm_cmpgt_epi8(v, lo), _mm_cmplt_epi8(v, hi));
+        __m128i mask = _mm_or_si128(in_range, _mm_cmpeq_epi8(v, tab));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), _mm_and_si128(mask, one));
+    }
+#endif
+    for (; i < len; ++i) {
+        out[i] = isPrintable(static_cast<unsigned char>(data[i]));
+    }
+}
+
+StringExtractor::StringExtractor(std::shared_ptr<const PieceTable> table, QVector<ByteRange> ranges,
+                                 int min_length, bool ascii, bool wide)
+    : table(table),
+      min_length(std::max(min_length, 1)),
+      ascii(ascii),
+      wide(wide),
+      next_result(0),
+      next_chunk(0),
+      cancel(false),
+      bytes_scanned(0),
+      bytes_total(0)
+{
+    for (auto &range : ranges) {
+        for (qint64 pos = range.begin; pos < range.end; pos += STRINGS_CHUNK) {
+            chunks.push_back({ pos, std::min(range.end, pos + STRINGS_CHUNK), range.end });
+        }
+        bytes_total += range.end - range.begin;
+    }
+    results.resize(chunks.size());
+
+    size_t nthreads = std::max(1u, std::thread::hardware_concurrency());
+    nthreads = std::min(nthreads, chunks.size());
+    for (size_t i = 0; i < nthreads; ++i) {
+        threads.emplace_back(&StringExtractor::worker, this);
+    }
+}
+
+StringExtractor::~StringExtractor()
+{
+    cancel = true;
+    for (auto &thread : threads) {
+        thread.join();
+    }
+}
+
+bool StringExtractor::takeResults(std::vector<FoundString> &out, std::string &arena)
+{
+    std::lock_guard<std::mutex> guard(results_lock);
+    while (next_result < results.size() && results[next_result].done) {
+        Result &result = results[next_result];
+        qint64 base = arena.size();
+        arena += result.text;
+        for (auto found : result.strings) {
+            found.text_pos += base;
+            out.push_back(found);
+        }
+        result = Result();
+        result.done = true;
+        ++next_result;
+    }
+    return next_result == results.size();
+}
+
+void StringExtractor::worker()
+{
+    for (;;) {
+        size_t idx = next_chunk++;
+        if (idx >= chunks.size() || cancel)
+            return;
+
+        Result result;
+        scanChunk(chunks[idx], result);
+        bytes_scanned += chunks[idx].end - chunks[idx].begin;
+
+        std::lock_guard<std::mutex> guard(results_lock);
+        results[idx] = std::move(result);
+        results[idx].done = true;
+    }
+}
+
+void StringExtractor::scanChunk(const Chunk &chunk, Result &result)
+{
+    // Include the units right before the chunk to see whether a string
+    // started earlier, and one more byte for the upper half of a UTF-16
+    // unit starting at the last offset
+    qint64 data_begin = std::max<qint64>(chunk.begin - 2, 0);
+    qint64 data_end = std::min(chunk.end + 1, chunk.range_end);
+    qint64 data_len = data_end - data_begin;
+
+    std::vector<char> data(data_len);
+    std::vector<unsigned char> cls(data_len);
+    data_len = table->read(data_begin, data.data(), data_len);
+    classify(data.data(), data_len, cls.data());
+
+    if (ascii) {
+        scanUnits(chunk, data.data(), cls.data(), data_begin, data_len, chunk.begin, 1, result);
+    }
+    if (wide) {
+        // UTF-16 strings can start at either parity
+        scanUnits(chunk, data.data(), cls.data(), data_begin, data_len, chunk.begin, 2, result);
+        scanUnits(chunk, data.data(), cls.data(), data_begin, data_len, chunk.begin + 1, 2, result);
+    }
+
+    // Strings of both kinds were appended separately
+    if (ascii && wide) {
+        std::sort(result.strings.begin(), result.strings.end(),
+            [](const FoundString &a, const FoundString &b) { return a.offset < b.offset; });
+    }
+}
+
+void StringExtractor::scanUnits(const Chunk &chunk, const char *data, const unsigned char *cls,
+                                qint64 data_begin, qint64 data_len, qint64 first, int stride,
+                                Result &result)
+{
+    // Printable ASCII characters, or the same followed by a zero byte
+    auto inBuffer = [&](qint64 pos) {
+        return pos >= data_begin && pos - data_begin + stride <= data_len;
+    };
+    auto printable = [&](qint64 pos) {
+        qint64 idx = pos - data_begin;
+        return cls[idx] && (stride == 1 || data[idx + 1] == 0);
+    };
+
+    qint64 pos = first;
+
+    // A string running into the chunk belongs to the previous chunk
+    if (inBuffer(pos - stride) && printable(pos - stride)) {
+        while (pos < chunk.end && inBuffer(pos) && printable(pos)) {
+            pos += stride;
+        }
+    }
+
+    while (pos < chunk.end && inBuffer(pos)) {
+        if (cancel)
+            return;
+        if (!printable(pos)) {
+            pos += stride;
+            continue;
+        }
+
+        qint64 start = pos;
+        qint64 text_pos = result.text.size();
+        while (inBuffer(pos) && printable(pos)) {
+            if (pos - start < MAX_TEXT * stride) {
+                result.text += data[pos - data_begin];
+            }
+            pos += stride;
+        }
+
+        // Follow strings reaching the end of the buffer until they end
+        if (!inBuffer(pos)) {
+            std::vector<char> ext(EXTEND_BLOCK);
+            while (pos < chunk.range_end && !cancel) {
+                qint64 cnt = table->read(pos, ext.data(), std::min(EXTEND_BLOCK, chunk.range_end - pos));
+                qint64 i = 0;
+                while (i + stride <= cnt && isPrintable(ext[i]) && (stride == 1 || ext[i + 1] == 0)) {
+                    if (pos + i - start < MAX_TEXT * stride) {
+                        result.text += ext[i];
+                    }
+                    i += stride;
+                }
+                pos += i;
+                if (i + stride <= cnt || i == 0)
+                    break;
+            }
+        }
+
+        qint64 length = pos - start;
+        if (length / stride >= min_length) {
+            int text_len = static_cast<int>(result.text.size() - text_pos);
+            result.strings.push_back({ start, length, text_pos, text_len, stride == 2 });
+        } else {
+            result.text.resize(text_pos);
+        }
+    }
+}
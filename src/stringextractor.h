@@ -0,0 +1,104 @@
+/*
+ * HexEditor -- Qt based hex editor
+ * Copyright (C) 2021  Mate Kukri
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef STRINGEXTRACTOR_H
+#define STRINGEXTRACTOR_H
+
+#include <QVector>
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "document.h"
+
+//
+// Printable string found in a document
+//
+struct FoundString
+{
+    qint64 offset;
+    // Length of the string in bytes
+    qint64 length;
+    // Stored text, truncated for display
+    qint64 text_pos;
+    int text_len;
+    // UTF-16LE instead of ASCII
+    bool wide;
+};
+
+//
+// Background extraction of ASCII and UTF-16LE strings
+//
+// A pool of threads scans chunks of a snapshot of the document. Results
+// are handed out in offset order as soon as every chunk before them is done,
+// so they can be displayed while the scan is still running.
+//
+class StringExtractor
+{
+public:
+    StringExtractor(std::shared_ptr<const PieceTable> table, QVector<ByteRange> ranges,
+                    int min_length, bool ascii, bool wide);
+    ~StringExtractor();
+
+    // Append the results ready since the last call to out, their text is
+    // appended to arena, returns true once the whole document was scanned
+    bool takeResults(std::vector<FoundString> &out, std::string &arena);
+
+    // Number of bytes scanned so far and in total
+    qint64 scanned() { return bytes_scanned; }
+    qint64 total() { return bytes_total; }
+
+private:
+    struct Chunk {
+        qint64 begin, end;
+        // Strings may run on until the end of the range
+        qint64 range_end;
+    };
+
+    struct Result {
+        std::vector<FoundString> strings;
+        std::string text;
+        bool done = false;
+    };
+
+    std::shared_ptr<const PieceTable> table;
+    int min_length;
+    bool ascii, wide;
+
+    std::vector<Chunk> chunks;
+    std::vector<Result> results;
+    size_t next_result;
+    std::mutex results_lock;
+
+    std::atomic<size_t> next_chunk;
+    std::atomic<bool> cancel;
+    std::atomic<qint64> bytes_scanned;
+    qint64 bytes_total;
+    std::vector<std::thread> threads;
+
+    void worker();
+    void scanChunk(const Chunk &chunk, Result &result);
+
+    // Scan units of stride bytes starting at the absolute offset first
+    void scanUnits(const Chunk &chunk, const char *data, const unsigned char *cls,
+                   qint64 data_begin, qint64 data_len, qint64 first, int stride,
+                   Result &result);
+};
+
+#endif // STRINGEXTRACTOR_H
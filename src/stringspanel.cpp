@@ -0,0 +1,281 @@
+/*
+ * HexEditor -- Qt based hex editor
+ * Copyright (C) 2021  Mate Kukri
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "stringspanel.h"
+#include <QHeaderView>
+#include <QItemSelectionModel>
+#include <algorithm>
+#include <cctype>
+
+// How often results are collected while a scan runs
+static int POLL_INTERVAL = 100;
+
+// Delay between the last keystroke in the filter and applying it
+static int FILTER_DELAY = 200;
+
+StringsModel::StringsModel(QObject *parent)
+    : QAbstractTableModel(parent),
+      held_bytes(0)
+{
+    MemoryGovernor::instance().add(this);
+}
+
+StringsModel::~StringsModel()
+{
+    MemoryGovernor::instance().remove(this);
+}
+
+void StringsModel::updateHeldBytes()
+{
+    held_bytes = strings.capacity() * sizeof(FoundString)
+        + arena.capacity()
+        + visible.capacity() * sizeof(size_t);
+}
+
+int StringsModel::rowCount(const QModelIndex &parent) const
+{
+    if (parent.isValid())
+        return 0;
+    return static_cast<int>(filter.isEmpty() ? strings.size() : visible.size());
+}
+
+int StringsModel::columnCount(const QModelIndex &parent) const
+{
+    if (parent.isValid())
+        return 0;
+    return 3;
+}
+
+const FoundString &StringsModel::stringAt(int row) const
+{
+    return filter.isEmpty() ? strings[row] : strings[visible[row]];
+}
+
+QVariant StringsModel::data(const QModelIndex &index, int role) const
+{
+    if (role != Qt::DisplayRole || !index.isValid() || index.row() >= rowCount())
+        return QVariant();
+
+    const FoundString &found = stringAt(index.row());
+    switch (index.column()) {
+    case 0:
+        return QString::asprintf("%08llx", static_cast<unsigned long long>(found.offset));
+    case 1:
+        return found.wide ? QString("UTF-16") : QString("ASCII");
+    case 2: {
+        QString text = QString::fromLatin1(arena.data() + found.text_pos, found.text_len);
+        if (found.length / (found.wide ? 2 : 1) > found.text_len) {
+            text += "...";
+        }
+        return text;
+    }
+    }
+    return QVariant();
+}
+
+QVariant StringsModel::headerData(int section, Qt::Orientation orientation, int role) const
+{
+    if (role != Qt::DisplayRole || orientation != Qt::Orientation::Horizontal)
+        return QVariant();
+
+    switch (section) {
+    case 0: return QString("Offset");
+    case 1: return QString("Type");
+    case 2: return QString("String");
+    }
+    return QVariant();
+}
+
+bool StringsModel::matches(const FoundString &found) const
+{
+    const char *begin = arena.data() + found.text_pos;
+    const char *end = begin + found.text_len;
+    return std::search(begin, end, filter.constData(), filter.constData() + filter.size(),
+        [](char a, char b) { return tolower(static_cast<unsigned char>(a)) == b; }) != end;
+}
+
+bool StringsModel::takeResults(StringExtractor &extractor)
+{
+    std::vector<FoundString> new_strings;
+    bool done = extractor.takeResults(new_strings, arena);
+    if (new_strings.empty())
+        return done;
+
+    // Work out which of the new strings will become rows
+    size_t first_new = strings.size();
+    std::vector<size_t> new_visible;
+    if (!filter.isEmpty()) {
+        for (size_t i = 0; i < new_strings.size(); ++i) {
+            if (matches(new_strings[i])) {
+                new_visible.push_back(first_new + i);
+            }
+        }
+    }
+
+    int new_rows = static_cast<int>(filter.isEmpty() ? new_strings.size() : new_visible.size());
+    if (new_rows > 0) {
+        beginInsertRows(QModelIndex(), rowCount(), rowCount() + new_rows - 1);
+    }
+    strings.insert(strings.end(), new_strings.begin(), new_strings.end());
+    visible.insert(visible.end(), new_visible.begin(), new_visible.end());
+    if (new_rows > 0) {
+        endInsertRows();
+    }
+
+    updateHeldBytes();
+    MemoryGovernor::instance().charge();
+    return done;
+}
+
+void StringsModel::setFilter(QString text)
+{
+    beginResetModel();
+    filter = text.toLatin1().toLower();
+    visible.clear();
+    if (!filter.isEmpty()) {
+        for (size_t i = 0; i < strings.size(); ++i) {
+            if (matches(strings[i])) {
+                visible.push_back(i);
+            }
+        }
+    }
+    endResetModel();
+    updateHeldBytes();
+}
+
+void StringsModel::clear()
+{
+    beginResetModel();
+    std::vector<FoundString>().swap(strings);
+    std::string().swap(arena);
+    std::vector<size_t>().swap(visible);
+    endResetModel();
+    updateHeldBytes();
+}
+
+StringsPanel::StringsPanel(QWidget *parent) :
+    QDockWidget(tr("Strings"), parent),
+    contents(this),
+    options_box(&contents),
+    min_length_label("Min length:", &options_box),
+    min_length_spin_box(&options_box),
+    ascii_check_box("ASCII", &options_box),
+    wide_check_box("UTF-16LE", &options_box),
+    scan_button("Scan", &options_box),
+    filter_line_edit(&contents),
+    table_view(&contents),
+    status_label(&contents)
+{
+    // Setup options box
+    min_length_spin_box.setRange(1, 1024);
+    min_length_spin_box.setValue(4);
+    ascii_check_box.setChecked(true);
+    wide_check_box.setChecked(true);
+    options_box_layout.addWidget(&min_length_label);
+    options_box_layout.addWidget(&min_length_spin_box);
+    options_box_layout.addWidget(&ascii_check_box);
+    options_box_layout.addWidget(&wide_check_box);
+    options_box_layout.addStretch();
+    options_box_layout.addWidget(&scan_button);
+    options_box_layout.setMargin(0);
+    options_box.setLayout(&options_box_layout);
+
+    // Fixed row heights keep the view from measuring every row
+    filter_line_edit.setPlaceholderText("Filter");
+    table_view.setModel(&model);
+    table_view.setSelectionBehavior(QAbstractItemView::SelectionBehavior::SelectRows);
+    table_view.setSelectionMode(QAbstractItemView::SelectionMode::SingleSelection);
+    table_view.verticalHeader()->setSectionResizeMode(QHeaderView::ResizeMode::Fixed);
+    table_view.verticalHeader()->setDefaultSectionSize(table_view.fontMetrics().height() + 4);
+    table_view.verticalHeader()->hide();
+    table_view.horizontalHeader()->setStretchLastSection(true);
+    table_view.setFont(QFont("DejaVu Sans Mono"));
+
+    // Setup main UI
+    layout.addWidget(&options_box);
+    layout.addWidget(&filter_line_edit);
+    layout.addWidget(&table_view);
+    layout.addWidget(&status_label);
+    contents.setLayout(&layout);
+    setWidget(&contents);
+
+    poll_timer.setInterval(POLL_INTERVAL);
+    filter_timer.setInterval(FILTER_DELAY);
+    filter_timer.setSingleShot(true);
+
+    // Connect event handlers
+    QObject::connect(&scan_button, SIGNAL(clicked()), this, SIGNAL(scanRequested()));
+    QObject::connect(&filter_line_edit, SIGNAL(textChanged(QString)), &filter_timer, SLOT(start()));
+    QObject::connect(&filter_timer, SIGNAL(timeout()), this, SLOT(handleFilterTimeout()));
+    QObject::connect(&poll_timer, SIGNAL(timeout()), this, SLOT(handlePoll()));
+    QObject::connect(table_view.selectionModel(), SIGNAL(currentRowChanged(QModelIndex, QModelIndex)),
+                     this, SLOT(handleCurrentChanged(QModelIndex)));
+}
+
+void StringsPanel::scan(std::shared_ptr<Document> document)
+{
+    // Stop the previous scan before dropping its results
+    extractor.reset();
+    model.clear();
+
+    this->document = document;
+    model.setOwner(document->memoryOwner());
+    extractor.reset(new StringExtractor(document->snapshot(),
+                                        document->mappedRanges(0, document->size()),
+                                        min_length_spin_box.value(),
+                                        ascii_check_box.isChecked(),
+                                        wide_check_box.isChecked()));
+    poll_timer.start();
+    handlePoll();
+}
+
+void StringsPanel::updateStatus(bool done)
+{
+    QString status = QString("%1 strings").arg(model.totalCount());
+    if (!done && extractor->total() > 0) {
+        status += QString(", %1% scanned").arg(extractor->scanned() * 100 / extractor->total());
+    }
+    status_label.setText(status);
+}
+
+void StringsPanel::handlePoll()
+{
+    if (!extractor)
+        return;
+
+    bool done = model.takeResults(*extractor);
+    updateStatus(done);
+    if (done) {
+        poll_timer.stop();
+        extractor.reset();
+    }
+}
+
+void StringsPanel::handleFilterTimeout()
+{
+    model.setFilter(filter_line_edit.text());
+}
+
+void StringsPanel::handleCurrentChanged(const QModelIndex &current)
+{
+    if (!current.isValid())
+        return;
+
+    const FoundString &found = model.stringAt(current.row());
+    emit stringActivated(found.offset, found.length);
+}
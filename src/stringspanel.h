@@ -0,0 +1,141 @@
+/*
+ * HexEditor -- Qt based hex editor
+ * Copyright (C) 2021  Mate Kukri
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef STRINGSPANEL_H
+#define STRINGSPANEL_H
+
+#include <QAbstractTableModel>
+#include <QCheckBox>
+#include <QDockWidget>
+#include <QHBoxLayout>
+#include <QLabel>
+#include <QLineEdit>
+#include <QPushButton>
+#include <QSpinBox>
+#include <QTableView>
+#include <QTimer>
+#include <QVBoxLayout>
+#include <memory>
+#include "memorygovernor.h"
+#include "stringextractor.h"
+
+//
+// Table of extracted strings
+//
+// Only the rows on screen are ever turned into QStrings, so the view stays
+// responsive with millions of entries.
+//
+class StringsModel : public QAbstractTableModel, public MemoryConsumer
+{
+    Q_OBJECT
+
+public:
+    explicit StringsModel(QObject *parent = nullptr);
+    ~StringsModel() override;
+
+    int rowCount(const QModelIndex &parent = QModelIndex()) const override;
+    int columnCount(const QModelIndex &parent = QModelIndex()) const override;
+    QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const override;
+    QVariant headerData(int section, Qt::Orientation orientation,
+                        int role = Qt::DisplayRole) const override;
+
+    // Append whatever extractor has ready, returns true once it is done
+    bool takeResults(StringExtractor &extractor);
+
+    // Only show strings containing text, ignoring case
+    void setFilter(QString text);
+
+    void clear();
+    const FoundString &stringAt(int row) const;
+    qint64 totalCount() const { return strings.size(); }
+
+    // Results are only dropped by the user, so they don't count against
+    // the budget
+    QString memoryOwner() override { return owner; }
+    QString memoryKind() override { return tr("Strings"); }
+    qint64 memoryUsage() override { return held_bytes; }
+    void setOwner(QString owner) { this->owner = owner; }
+
+private:
+    std::vector<FoundString> strings;
+    std::string arena;
+    QString owner;
+    std::atomic<qint64> held_bytes;
+
+    // Indices of the strings matching the filter
+    QByteArray filter;
+    std::vector<size_t> visible;
+
+    bool matches(const FoundString &found) const;
+    void updateHeldBytes();
+};
+
+//
+// Dockable list of the strings in a document
+//
+class StringsPanel : public QDockWidget
+{
+    Q_OBJECT
+
+public:
+    explicit StringsPanel(QWidget *parent = nullptr);
+
+    // Start extracting the strings of document
+    void scan(std::shared_ptr<Document> document);
+
+    // Document the list belongs to, nullptr once it was closed
+    std::shared_ptr<Document> getDocument() { return document.lock(); }
+
+signals:
+    // The user wants the current document scanned
+    void scanRequested();
+
+    // An entry was selected
+    void stringActivated(qint64 offset, qint64 length);
+
+private:
+    // UI
+    QWidget contents;
+    QWidget options_box;
+    QLabel min_length_label;
+    QSpinBox min_length_spin_box;
+    QCheckBox ascii_check_box;
+    QCheckBox wide_check_box;
+    QPushButton scan_button;
+    QHBoxLayout options_box_layout;
+    QLineEdit filter_line_edit;
+    QTableView table_view;
+    QLabel status_label;
+    QVBoxLayout layout;
+
+    StringsModel model;
+    QTimer poll_timer;
+    QTimer filter_timer;
+
+    std::weak_ptr<Document> document;
+    std::unique_ptr<StringExtractor> extractor;
+
+    void updateStatus(bool done);
+
+private slots:
+    void handlePoll();
+    void handleFilterTimeout();
+    void handleCurrentChanged(const QModelIndex &current);
+};
+
+#endif // STRINGSPANEL_H
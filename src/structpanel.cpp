@@ -0,0 +1,300 @@
+/*
+ * HexEditor -- Qt based hex editor
+ * Copyright (C) 2021  Mate Kukri
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "structpanel.h"
+#include <QFile>
+#include <QFileDialog>
+#include <QFileInfo>
+#include <QHeaderView>
+#include <QItemSelectionModel>
+#include <QMessageBox>
+#include <QSettings>
+#include <QTimer>
+#include <limits>
+
+// Array elements kept decoded for the tree before unused ones are dropped
+static qint64 ELEMENT_CACHE = 16384;
+
+StructModel::StructModel(QObject *parent)
+    : QAbstractItemModel(parent),
+      trim_pending(false)
+{
+}
+
+TemplateInstance::Node *StructModel::nodeAt(const QModelIndex &index) const
+{
+    return static_cast<TemplateInstance::Node*>(index.internalPointer());
+}
+
+QModelIndex StructModel::index(int row, int column, const QModelIndex &parent) const
+{
+    if (!instance || row < 0 || column < 0 || column >= columnCount())
+        return QModelIndex();
+
+    // The applied struct is the only top level row
+    if (!parent.isValid())
+        return row == 0 ? createIndex(row, column, instance->root()) : QModelIndex();
+    if (row >= rowCount(parent))
+        return QModelIndex();
+    QModelIndex index = createIndex(row, column, instance->child(nodeAt(parent), row));
+
+    // Views ask for indexes while painting, trim once they are done
+    if (instance->cachedElements() > ELEMENT_CACHE && !trim_pending) {
+        trim_pending = true;
+        QTimer::singleShot(0, this, SLOT(trimElements()));
+    }
+    return index;
+}
+
+void StructModel::trimElements()
+{
+    trim_pending = false;
+    if (!instance || instance->cachedElements() <= ELEMENT_CACHE)
+        return;
+
+    // Expanded, current and selected rows stay where they are, views ask
+    // for everything else again after the layout change
+    emit layoutAboutToBeChanged();
+    std::vector<TemplateInstance::Node*> keep;
+    for (const QModelIndex &index : persistentIndexList()) {
+        keep.push_back(nodeAt(index));
+    }
+    instance->dropElements(keep);
+    emit layoutChanged();
+}
+
+QModelIndex StructModel::parent(const QModelIndex &index) const
+{
+    if (!index.isValid())
+        return QModelIndex();
+
+    TemplateInstance::Node *parent = instance->parent(nodeAt(index));
+    if (!parent)
+        return QModelIndex();
+    return createIndex(static_cast<int>(instance->row(parent)), 0, parent);
+}
+
+int StructModel::rowCount(const QModelIndex &parent) const
+{
+    if (!instance || parent.column() > 0)
+        return 0;
+    if (!parent.isValid())
+        return 1;
+
+    // Views can't have more rows than an int holds
+    qint64 count = instance->childCount(nodeAt(parent));
+    return static_cast<int>(std::min<qint64>(count, std::numeric_limits<int>::max()));
+}
+
+int StructModel::columnCount(const QModelIndex &) const
+{
+    return 4;
+}
+
+bool StructModel::hasChildren(const QModelIndex &parent) const
+{
+    if (!instance || parent.column() > 0)
+        return false;
+    if (!parent.isValid())
+        return true;
+    return instance->hasChildren(nodeAt(parent));
+}
+
+QVariant StructModel::data(const QModelIndex &index, int role) const
+{
+    if (role != Qt::DisplayRole || !index.isValid())
+        return QVariant();
+
+    TemplateInstance::Node *node = nodeAt(index);
+    switch (index.column()) {
+    case 0:
+        return instance->name(node);
+    case 1:
+        return QString::asprintf("%08llx", static_cast<unsigned long long>(instance->offset(node)));
+    case 2:
+        return instance->typeName(node);
+    case 3:
+        return instance->value(node);
+    }
+    return QVariant();
+}
+
+QVariant StructModel::headerData(int section, Qt::Orientation orientation, int role) const
+{
+    if (role != Qt::DisplayRole || orientation != Qt::Orientation::Horizontal)
+        return QVariant();
+
+    switch (section) {
+    case 0: return QString("Name");
+    case 1: return QString("Offset");
+    case 2: return QString("Type");
+    case 3: return QString("Value");
+    }
+    return QVariant();
+}
+
+void StructModel::setInstance(std::shared_ptr<TemplateInstance> instance)
+{
+    beginResetModel();
+    this->instance = instance;
+    endResetModel();
+}
+
+void StructModel::invalidate()
+{
+    if (!instance)
+        return;
+
+    beginResetModel();
+    instance->invalidate();
+    endResetModel();
+}
+
+bool StructModel::fieldAt(const QModelIndex &index, qint64 &offset, qint64 &length)
+{
+    if (!instance || !index.isValid())
+        return false;
+
+    TemplateInstance::Node *node = nodeAt(index);
+    offset = instance->offset(node);
+    length = instance->size(node);
+    return length > 0;
+}
+
+StructPanel::StructPanel(QWidget *parent) :
+    QDockWidget(tr("Structure"), parent),
+    contents(this),
+    options_box(&contents),
+    load_button("Load...", &options_box),
+    struct_combo_box(&options_box),
+    apply_button("Apply at Cursor", &options_box),
+    tree_view(&contents),
+    status_label("No template loaded", &contents)
+{
+    // Setup options box
+    struct_combo_box.setSizeAdjustPolicy(QComboBox::SizeAdjustPolicy::AdjustToContents);
+    apply_button.setEnabled(false);
+    options_box_layout.addWidget(&load_button);
+    options_box_layout.addWidget(&struct_combo_box);
+    options_box_layout.addStretch();
+    options_box_layout.addWidget(&apply_button);
+    options_box_layout.setMargin(0);
+    options_box.setLayout(&options_box_layout);
+
+    // Uniform rows let the view skip measuring huge arrays
+    tree_view.setModel(&model);
+    tree_view.setUniformRowHeights(true);
+    tree_view.setSelectionBehavior(QAbstractItemView::SelectionBehavior::SelectRows);
+    tree_view.setSelectionMode(QAbstractItemView::SelectionMode::SingleSelection);
+    tree_view.header()->setStretchLastSection(true);
+    tree_view.setFont(QFont("DejaVu Sans Mono"));
+
+    // Setup main UI
+    layout.addWidget(&options_box);
+    layout.addWidget(&tree_view);
+    layout.addWidget(&status_label);
+    contents.setLayout(&layout);
+    setWidget(&contents);
+
+    // Connect event handlers
+    QObject::connect(&load_button, SIGNAL(clicked()), this, SLOT(handleLoad()));
+    QObject::connect(&apply_button, SIGNAL(clicked()), this, SIGNAL(applyRequested()));
+    QObject::connect(tree_view.selectionModel(), SIGNAL(currentRowChanged(QModelIndex, QModelIndex)),
+                     this, SLOT(handleCurrentChanged(QModelIndex)));
+
+    // Pick up the template used last time, quietly
+    QString last = QSettings().value("structs/template").toString();
+    if (!last.isEmpty()) {
+        try {
+            loadTemplate(last);
+        } catch (QString) {
+        }
+    }
+}
+
+void StructPanel::loadTemplate(QString file_name)
+{
+    QFile file(file_name);
+    if (!file.open(QFile::ReadOnly))
+        throw QString("Failed to open %1: %2").arg(file_name, file.errorString());
+
+    auto loaded = std::make_shared<StructTemplate>(QString::fromUtf8(file.readAll()));
+    structs = loaded;
+    struct_combo_box.clear();
+    struct_combo_box.addItems(structs->structNames());
+    apply_button.setEnabled(true);
+    status_label.setText(QFileInfo(file_name).fileName());
+}
+
+void StructPanel::handleLoad()
+{
+    QString file_name = QFileDialog::getOpenFileName(this, tr("Load Template"));
+    if (file_name.isEmpty())
+        return;
+
+    try {
+        loadTemplate(file_name);
+        QSettings().setValue("structs/template", file_name);
+    } catch (QString err) {
+        QMessageBox msgBox(this);
+        msgBox.setText(err);
+        msgBox.setIcon(QMessageBox::Icon::Critical);
+        msgBox.exec();
+    }
+}
+
+std::shared_ptr<TemplateInstance> StructPanel::apply(std::shared_ptr<Document> document, qint64 offset)
+{
+    if (!structs)
+        return nullptr;
+    auto root_type = structs->findStruct(struct_combo_box.currentText());
+    if (!root_type)
+        return nullptr;
+
+    clear();
+    this->document = document;
+    QObject::connect(document.get(), SIGNAL(changed()), this, SLOT(handleDocumentChanged()));
+    model.setInstance(std::make_shared<TemplateInstance>(document, structs, root_type, offset));
+    tree_view.expand(model.index(0, 0));
+    return model.getInstance();
+}
+
+void StructPanel::clear()
+{
+    auto old = document.lock();
+    if (old) {
+        QObject::disconnect(old.get(), SIGNAL(changed()), this, SLOT(handleDocumentChanged()));
+    }
+    document.reset();
+    model.setInstance(nullptr);
+}
+
+void StructPanel::handleDocumentChanged()
+{
+    // Edits may move anything, so everything decoded goes
+    model.invalidate();
+    tree_view.expand(model.index(0, 0));
+}
+
+void StructPanel::handleCurrentChanged(const QModelIndex &current)
+{
+    qint64 offset, length;
+    if (model.fieldAt(current, offset, length)) {
+        emit fieldActivated(offset, length);
+    }
+}
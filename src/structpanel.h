@@ -0,0 +1,125 @@
+/*
+ * HexEditor -- Qt based hex editor
+ * Copyright (C) 2021  Mate Kukri
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef STRUCTPANEL_H
+#define STRUCTPANEL_H
+
+#include <QAbstractItemModel>
+#include <QComboBox>
+#include <QDockWidget>
+#include <QHBoxLayout>
+#include <QLabel>
+#include <QPushButton>
+#include <QTreeView>
+#include <QVBoxLayout>
+#include <memory>
+#include "structtemplate.h"
+
+//
+// Tree of the fields of an applied template
+//
+// Rows are produced on demand from the instance, so collapsed structs and
+// array elements scrolled out of view are never decoded. Once too many
+// elements were decoded, those no view holds on to are dropped again.
+//
+class StructModel : public QAbstractItemModel
+{
+    Q_OBJECT
+
+public:
+    explicit StructModel(QObject *parent = nullptr);
+
+    QModelIndex index(int row, int column, const QModelIndex &parent = QModelIndex()) const override;
+    QModelIndex parent(const QModelIndex &index) const override;
+    int rowCount(const QModelIndex &parent = QModelIndex()) const override;
+    int columnCount(const QModelIndex &parent = QModelIndex()) const override;
+    bool hasChildren(const QModelIndex &parent = QModelIndex()) const override;
+    QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const override;
+    QVariant headerData(int section, Qt::Orientation orientation,
+                        int role = Qt::DisplayRole) const override;
+
+    void setInstance(std::shared_ptr<TemplateInstance> instance);
+    std::shared_ptr<TemplateInstance> getInstance() { return instance; }
+
+    // Drop decoded fields after the document changed
+    void invalidate();
+
+    // Field at index, offset and length in bytes
+    bool fieldAt(const QModelIndex &index, qint64 &offset, qint64 &length);
+
+private:
+    std::shared_ptr<TemplateInstance> instance;
+    mutable bool trim_pending;
+
+    TemplateInstance::Node *nodeAt(const QModelIndex &index) const;
+
+private slots:
+    void trimElements();
+};
+
+//
+// Dockable view of a structure template applied to a document
+//
+class StructPanel : public QDockWidget
+{
+    Q_OBJECT
+
+public:
+    explicit StructPanel(QWidget *parent = nullptr);
+
+    // Apply the selected struct at offset of document
+    std::shared_ptr<TemplateInstance> apply(std::shared_ptr<Document> document, qint64 offset);
+
+    // Forget the applied template
+    void clear();
+
+    // Document the template was applied to, nullptr if none
+    std::shared_ptr<Document> getDocument() { return document.lock(); }
+
+signals:
+    // The user wants the template applied at the cursor
+    void applyRequested();
+
+    // A field was selected
+    void fieldActivated(qint64 offset, qint64 length);
+
+private:
+    // UI
+    QWidget contents;
+    QWidget options_box;
+    QPushButton load_button;
+    QComboBox struct_combo_box;
+    QPushButton apply_button;
+    QHBoxLayout options_box_layout;
+    QTreeView tree_view;
+    QLabel status_label;
+    QVBoxLayout layout;
+
+    StructModel model;
+    std::shared_ptr<StructTemplate> structs;
+    std::weak_ptr<Document> document;
+
+    void loadTemplate(QString file_name);
+
+private slots:
+    void handleLoad();
+    void handleDocumentChanged();
+    void handleCurrentChanged(const QModelIndex &current);
+};
+
+#endif // STRUCTPANEL_H
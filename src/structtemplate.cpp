@@ -0,0 +1,906 @@
+/*
+ * HexEditor -- Qt based hex editor
+ * Copyright (C) 2021  Mate Kukri
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "structtemplate.h"
+#include <algorithm>
+#include <limits>
+
+// Deepest nesting followed when collecting fields, pointers may form cycles
+static int MAX_DEPTH = 32;
+// Longest text shown for char arrays and bytes shown for byte arrays
+static int MAX_PREVIEW = 64;
+
+struct StructTemplate::Expr
+{
+    enum Kind { Number, Name, Unary, Binary } kind;
+    qint64 value;
+    QString name;
+    QString op;
+    std::shared_ptr<Expr> lhs, rhs;
+};
+
+//
+// Recursive descent parser for template text
+//
+class TemplateParser
+{
+public:
+    explicit TemplateParser(QString text);
+
+    bool atEnd() { return pos >= tokens.size(); }
+    QString peek() { return atEnd() ? QString() : tokens[pos].text; }
+    QString next();
+    void expect(QString text);
+    QString identifier();
+    [[noreturn]] void error(QString message);
+
+    std::shared_ptr<StructTemplate::Expr> expression(int level = 0);
+
+private:
+    struct Token {
+        QString text;
+        int line;
+    };
+    std::vector<Token> tokens;
+    size_t pos;
+
+    std::shared_ptr<StructTemplate::Expr> primary();
+};
+
+// Binary operators from the loosest to the tightest binding
+static const std::vector<QStringList> BINARY_OPS = {
+    { "||" }, { "&&" }, { "|" }, { "^" }, { "&" }, { "==", "!=" },
+    { "<", "<=", ">", ">=" }, { "<<", ">>" }, { "+", "-" }, { "*", "/", "%" },
+};
+
+TemplateParser::TemplateParser(QString text)
+    : pos(0)
+{
+    static const QStringList two_char = { "==", "!=", "<=", ">=", "<<", ">>", "&&", "||" };
+    int line = 1;
+    for (int i = 0; i < text.size();) {
+        QChar c = text[i];
+        if (c == '\n') {
+            ++line;
+            ++i;
+        } else if (c.isSpace()) {
+            ++i;
+        } else if (c == '#' || text.mid(i, 2) == "//") {
+            while (i < text.size() && text[i] != '\n') {
+                ++i;
+            }
+        } else if (c.isLetterOrNumber() || c == '_') {
+            int start = i;
+            while (i < text.size() && (text[i].isLetterOrNumber() || text[i] == '_')) {
+                ++i;
+            }
+            tokens.push_back({ text.mid(start, i - start), line });
+        } else if (two_char.contains(text.mid(i, 2))) {
+            tokens.push_back({ text.mid(i, 2), line });
+            i += 2;
+        } else {
+            tokens.push_back({ QString(c), line });
+            ++i;
+        }
+    }
+}
+
+void TemplateParser::error(QString message)
+{
+    int line = tokens.empty() ? 1 : tokens[std::min(pos, tokens.size() - 1)].line;
+    throw QString("Line %1: %2").arg(line).arg(message);
+}
+
+QString TemplateParser::next()
+{
+    if (atEnd())
+        error("unexpected end of template");
+    return tokens[pos++].text;
+}
+
+void TemplateParser::expect(QString text)
+{
+    if (peek() != text)
+        error(QString("expected \"%1\"").arg(text));
+    ++pos;
+}
+
+QString TemplateParser::identifier()
+{
+    QString text = next();
+    if (!(text[0].isLetter() || text[0] == '_')) {
+        --pos;
+        error(QString("expected a name instead of \"%1\"").arg(text));
+    }
+    return text;
+}
+
+std::shared_ptr<StructTemplate::Expr> TemplateParser::expression(int level)
+{
+    if (level == static_cast<int>(BINARY_OPS.size()))
+        return primary();
+
+    auto lhs = expression(level + 1);
+    while (BINARY_OPS[level].contains(peek())) {
+        auto expr = std::make_shared<StructTemplate::Expr>();
+        expr->kind = StructTemplate::Expr::Binary;
+        expr->op = next();
+        expr->lhs = lhs;
+        expr->rhs = expression(level + 1);
+        lhs = expr;
+    }
+    return lhs;
+}
+
+std::shared_ptr<StructTemplate::Expr> TemplateParser::primary()
+{
+    auto expr = std::make_shared<StructTemplate::Expr>();
+    QString text = next();
+    if (text == "(") {
+        expr = expression();
+        expect(")");
+    } else if (text == "-" || text == "!" || text == "~") {
+        expr->kind = StructTemplate::Expr::Unary;
+        expr->op = text;
+        expr->lhs = primary();
+    } else if (text[0].isDigit()) {
+        bool ok;
+        expr->kind = StructTemplate::Expr::Number;
+        expr->value = text.toLongLong(&ok, 0);
+        if (!ok) {
+            --pos;
+            error(QString("invalid number \"%1\"").arg(text));
+        }
+    } else {
+        --pos;
+        expr->kind = StructTemplate::Expr::Name;
+        expr->name = identifier();
+    }
+    return expr;
+}
+
+// Fill in member for a scalar type name, returns false if it isn't one
+static bool parseScalarType(QString type, StructTemplate::Member &member)
+{
+    member.is_char = type == "char";
+    member.big_endian = type.endsWith("be");
+    if (member.is_char) {
+        member.scalar_size = 1;
+        member.is_signed = false;
+        return true;
+    }
+    if (member.big_endian) {
+        type.chop(2);
+    }
+    if (type.size() < 2 || (type[0] != 'u' && type[0] != 'i'))
+        return false;
+
+    int bits = type.mid(1).toInt();
+    if (bits != 8 && bits != 16 && bits != 32 && bits != 64)
+        return false;
+    member.is_signed = type[0] == 'i';
+    member.scalar_size = bits / 8;
+    return true;
+}
+
+static void parseMember(TemplateParser &parser, std::vector<StructTemplate::Member> &members,
+                        std::shared_ptr<StructTemplate::Expr> condition);
+
+static void parseMembers(TemplateParser &parser, std::vector<StructTemplate::Member> &members,
+                         std::shared_ptr<StructTemplate::Expr> condition)
+{
+    while (parser.peek() != "}") {
+        parseMember(parser, members, condition);
+    }
+}
+
+static void parseMember(TemplateParser &parser, std::vector<StructTemplate::Member> &members,
+                        std::shared_ptr<StructTemplate::Expr> condition)
+{
+    if (parser.peek() == "if") {
+        parser.next();
+        parser.expect("(");
+        auto expr = parser.expression();
+        parser.expect(")");
+        // Nested conditions must all hold
+        if (condition) {
+            auto both = std::make_shared<StructTemplate::Expr>();
+            both->kind = StructTemplate::Expr::Binary;
+            both->op = "&&";
+            both->lhs = condition;
+            both->rhs = expr;
+            expr = both;
+        }
+        if (parser.peek() == "{") {
+            parser.next();
+            parseMembers(parser, members, expr);
+            parser.expect("}");
+        } else {
+            parseMember(parser, members, expr);
+        }
+        return;
+    }
+
+    StructTemplate::Member member;
+    QString type = parser.identifier();
+    member.type = nullptr;
+    member.condition = condition;
+    if (!parseScalarType(type, member)) {
+        member.type_name = type;
+        member.scalar_size = 0;
+        member.is_signed = member.big_endian = member.is_char = false;
+    }
+    if (parser.peek() == "[") {
+        parser.next();
+        member.count = parser.expression();
+        parser.expect("]");
+    }
+    if (parser.peek() == "@") {
+        parser.next();
+        member.at = parser.expression();
+    }
+    member.name = parser.identifier();
+    parser.expect(";");
+    members.push_back(member);
+}
+
+StructTemplate::StructTemplate(QString text)
+{
+    TemplateParser parser(text);
+    while (!parser.atEnd()) {
+        parser.expect("struct");
+        auto def = std::make_unique<StructDef>();
+        def->name = parser.identifier();
+        if (findStruct(def->name))
+            parser.error(QString("struct %1 defined twice").arg(def->name));
+        parser.expect("{");
+        parseMembers(parser, def->members, nullptr);
+        parser.expect("}");
+        if (parser.peek() == ";") {
+            parser.next();
+        }
+        structs.push_back(std::move(def));
+    }
+    if (structs.empty())
+        throw QString("The template defines no structs");
+
+    // Resolve member types now that every struct is known
+    for (auto &def : structs) {
+        for (auto &member : def->members) {
+            if (member.type_name.isEmpty())
+                continue;
+            member.type = findStruct(member.type_name);
+            if (!member.type)
+                throw QString("%1.%2: unknown type %3").arg(def->name, member.name, member.type_name);
+        }
+    }
+
+    for (auto &def : structs) {
+        std::vector<StructDef*> stack;
+        staticSize(def.get(), stack);
+    }
+}
+
+qint64 StructTemplate::staticSize(StructDef *def, std::vector<StructDef*> &stack)
+{
+    if (std::find(stack.begin(), stack.end(), def) != stack.end())
+        throw QString("struct %1 contains itself").arg(def->name);
+
+    stack.push_back(def);
+    qint64 size = 0;
+    auto no_names = [](const QString &, qint64 &) { return false; };
+    for (auto &member : def->members) {
+        // Pointed to members take no space in the struct, and may recurse
+        if (member.at)
+            continue;
+
+        qint64 elem = member.scalar_size;
+        if (member.type) {
+            elem = staticSize(const_cast<StructDef*>(member.type), stack);
+        }
+        qint64 count = 1;
+        if (member.count && !evaluate(*member.count, no_names, count)) {
+            count = -1;
+        }
+        if (size < 0 || elem < 0 || count < 0 || member.condition) {
+            size = -1;
+        } else {
+            size += elem * count;
+        }
+    }
+    stack.pop_back();
+    def->static_size = size;
+    return size;
+}
+
+QStringList StructTemplate::structNames()
+{
+    QStringList names;
+    for (auto &def : structs) {
+        names.append(def->name);
+    }
+    return names;
+}
+
+const StructTemplate::StructDef *StructTemplate::findStruct(QString name)
+{
+    for (auto &def : structs) {
+        if (def->name == name)
+            return def.get();
+    }
+    return nullptr;
+}
+
+bool StructTemplate::evaluate(const Expr &expr, const std::function<bool(const QString &, qint64 &)> &lookup,
+                              qint64 &result)
+{
+    switch (expr.kind) {
+    case Expr::Number:
+        result = expr.value;
+        return true;
+    case Expr::Name:
+        return lookup(expr.name, result);
+    case Expr::Unary: {
+        qint64 val;
+        if (!evaluate(*expr.lhs, lookup, val))
+            return false;
+        result = expr.op == "-" ? static_cast<qint64>(0 - static_cast<quint64>(val))
+               : expr.op == "!" ? !val : ~val;
+        return true;
+    }
+    case Expr::Binary: {
+        qint64 a, b;
+        if (!evaluate(*expr.lhs, lookup, a))
+            return false;
+        // Short circuit so conditions can guard lookups
+        if (expr.op == "&&" && !a) {
+            result = 0;
+            return true;
+        }
+        if (expr.op == "||" && a) {
+            result = 1;
+            return true;
+        }
+        if (!evaluate(*expr.rhs, lookup, b))
+            return false;
+
+        const QString &op = expr.op;
+        if ((op == "/" || op == "%") && (b == 0 || (b == -1 && a == std::numeric_limits<qint64>::min())))
+            return false;
+        if ((op == "<<" || op == ">>") && (b < 0 || b > 63))
+            return false;
+        quint64 ua = a, ub = b;
+        if (op == "+") result = ua + ub;
+        else if (op == "-") result = ua - ub;
+        else if (op == "*") result = ua * ub;
+        else if (op == "/") result = a / b;
+        else if (op == "%") result = a % b;
+        else if (op == "<<") result = ua << b;
+        else if (op == ">>") result = a >> b;
+        else if (op == "&") result = a & b;
+        else if (op == "|") result = a | b;
+        else if (op == "^") result = a ^ b;
+        else if (op == "==") result = a == b;
+        else if (op == "!=") result = a != b;
+        else if (op == "<") result = a < b;
+        else if (op == "<=") result = a <= b;
+        else if (op == ">") result = a > b;
+        else if (op == ">=") result = a >= b;
+        else result = (op == "&&" || op == "||") && b;
+        return true;
+    }
+    }
+    return false;
+}
+
+struct TemplateInstance::Node
+{
+    enum Kind { Struct, Array, Scalar } kind;
+    // Member this node was declared by, nullptr for the root
+    const StructTemplate::Member *member;
+    // Struct type of struct nodes and struct arrays
+    const StructTemplate::StructDef *type;
+    Node *parent;
+    qint64 row;
+    qint64 offset;
+    // Extent in bytes, -1 until known
+    qint64 size;
+    // Elements of arrays are nodes with the member of their array
+    bool element;
+
+    // Scalars
+    bool has_value;
+    qint64 value;
+
+    // Structs, one entry per member present, laid out so far
+    bool laid_out;
+    std::vector<std::unique_ptr<Node>> fields;
+    // Next member to lay out, where it goes if it is inline, and the inline
+    // field before it if its extent isn't known yet
+    size_t next_member;
+    qint64 cursor;
+    Node *open_field;
+
+    // Arrays
+    qint64 count;
+    // Size of every element, -1 if it depends on the data
+    qint64 elem_size;
+    // Offsets of the elements laid out so far for variable sized elements,
+    // and the first element taking no space, every later one is the same
+    std::vector<qint64> elem_offsets;
+    qint64 empty_from;
+    std::map<qint64, std::unique_ptr<Node>> elements;
+
+    Node(Kind kind, const StructTemplate::Member *member, Node *parent, qint64 row, qint64 offset)
+        : kind(kind), member(member), type(member ? member->type : nullptr),
+          parent(parent), row(row), offset(offset), size(-1), element(false),
+          has_value(false), value(0), laid_out(false), next_member(0), cursor(offset),
+          open_field(nullptr), count(0), elem_size(-1), empty_from(-1) {}
+};
+
+TemplateInstance::TemplateInstance(std::shared_ptr<Document> document,
+                                   std::shared_ptr<StructTemplate> structs,
+                                   const StructTemplate::StructDef *root_type, qint64 offset)
+    : document(document),
+      structs(structs),
+      root_type(root_type),
+      base(offset),
+      element_count(0)
+{
+}
+
+TemplateInstance::~TemplateInstance()
+{
+}
+
+TemplateInstance::Node *TemplateInstance::root()
+{
+    if (!root_node) {
+        root_node = std::make_unique<Node>(Node::Struct, nullptr, nullptr, 0, base);
+        root_node->type = root_type;
+        root_node->size = root_type->static_size;
+    }
+    return root_node.get();
+}
+
+void TemplateInstance::invalidate()
+{
+    root_node.reset();
+    element_count = 0;
+}
+
+bool TemplateInstance::readScalar(const StructTemplate::Member &member, qint64 offset, qint64 &value)
+{
+    unsigned char buf[8];
+    int len = member.scalar_size;
+    if (offset < 0 || document->read(offset, reinterpret_cast<char*>(buf), len) != len)
+        return false;
+
+    quint64 val = 0;
+    for (int i = 0; i < len; ++i) {
+        val |= static_cast<quint64>(buf[member.big_endian ? len - 1 - i : i]) << (i * 8);
+    }
+    // Sign extend
+    if (member.is_signed && len < 8 && (val >> (len * 8 - 1)) & 1) {
+        val |= ~0ull << (len * 8);
+    }
+    value = static_cast<qint64>(val);
+    return true;
+}
+
+bool TemplateInstance::lookup(Node *node, const QString &name, qint64 &value)
+{
+    // Members before the one being laid out, then those of enclosing structs
+    // before the member we are in, even if more of them were laid out since
+    Node *below = nullptr;
+    for (; node; below = node, node = node->parent) {
+        if (node->kind != Node::Struct)
+            continue;
+        qint64 end = below ? below->row : static_cast<qint64>(node->fields.size());
+        for (auto it = node->fields.rend() - end; it != node->fields.rend(); ++it) {
+            Node *field = it->get();
+            if (field->member->name == name && field->kind == Node::Scalar) {
+                value = field->value;
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+void TemplateInstance::layoutStruct(Node *node, qint64 until)
+{
+    qint64 doc_size = document->size();
+    auto names = [&](const QString &name, qint64 &value) { return lookup(node, name, value); };
+    auto &members = node->type->members;
+    while (node->next_member < members.size()) {
+        const StructTemplate::Member &member = members[node->next_member];
+        // Inline members start where the one before ends, nothing past until
+        // is needed yet
+        if (!member.at && (!resolveOpenField(node, until) || node->cursor >= until))
+            return;
+        ++node->next_member;
+
+        qint64 cond = 1;
+        if (member.condition && (!StructTemplate::evaluate(*member.condition, names, cond) || !cond))
+            continue;
+
+        qint64 at = node->cursor;
+        if (member.at) {
+            if (!StructTemplate::evaluate(*member.at, names, at))
+                continue;
+            at += base;
+        }
+        if (at < 0 || at >= doc_size)
+            continue;
+
+        std::unique_ptr<Node> field;
+        if (member.count) {
+            qint64 count;
+            if (!StructTemplate::evaluate(*member.count, names, count) || count < 0)
+                continue;
+            field = std::make_unique<Node>(Node::Array, &member, node, node->fields.size(), at);
+            field->elem_size = member.type ? member.type->static_size : member.scalar_size;
+
+            // Never more elements than there are bytes left
+            qint64 left = doc_size - at;
+            count = std::min(count, left);
+            if (field->elem_size > 0) {
+                count = std::min(count, left / field->elem_size);
+            }
+            field->count = count;
+            if (field->elem_size >= 0) {
+                field->size = count * field->elem_size;
+            }
+        } else if (member.type) {
+            field = std::make_unique<Node>(Node::Struct, &member, node, node->fields.size(), at);
+            field->size = member.type->static_size;
+        } else {
+            field = std::make_unique<Node>(Node::Scalar, &member, node, node->fields.size(), at);
+            if (!readScalar(member, at, field->value))
+                continue;
+            field->has_value = true;
+            field->size = member.scalar_size;
+        }
+
+        // Variable sized fields are only laid out as far as they are looked at
+        if (!member.at && field->size >= 0) {
+            node->cursor += field->size;
+        } else if (!member.at) {
+            node->open_field = field.get();
+        }
+        node->fields.push_back(std::move(field));
+    }
+    node->laid_out = true;
+    if (!node->open_field) {
+        node->size = node->cursor - node->offset;
+    }
+}
+
+bool TemplateInstance::resolveOpenField(Node *node, qint64 until)
+{
+    if (!node->open_field)
+        return true;
+    if (!layoutUntil(node->open_field, until))
+        return false;
+    node->cursor = node->open_field->offset + node->open_field->size;
+    node->open_field = nullptr;
+    return true;
+}
+
+bool TemplateInstance::layoutUntil(Node *node, qint64 until)
+{
+    if (node->size >= 0)
+        return true;
+
+    if (node->kind == Node::Struct) {
+        layoutStruct(node, until);
+        if (!node->laid_out || !resolveOpenField(node, until))
+            return false;
+        node->size = node->cursor - node->offset;
+        return true;
+    }
+
+    // Arrays of variable sized elements
+    layoutArray(node, node->count, until);
+    qint64 laid_out = node->elem_offsets.size() - 1;
+    if (laid_out < node->count && node->empty_from < 0)
+        return false;
+    node->size = node->elem_offsets.back() - node->offset;
+    return true;
+}
+
+void TemplateInstance::layoutArray(Node *node, qint64 up_to, qint64 until)
+{
+    if (node->elem_offsets.empty()) {
+        node->elem_offsets.push_back(node->offset);
+    }
+
+    // Lay elements out one after the other, keeping only their offsets
+    qint64 doc_size = document->size();
+    while (static_cast<qint64>(node->elem_offsets.size()) <= up_to
+            && node->elem_offsets.back() < until && node->empty_from < 0) {
+        qint64 idx = node->elem_offsets.size() - 1;
+        qint64 at = node->elem_offsets.back();
+        qint64 end = at;
+        if (at < doc_size) {
+            Node elem(Node::Struct, node->member, node, idx, at);
+            elem.element = true;
+            layoutUntil(&elem, std::numeric_limits<qint64>::max());
+            end = at + elem.size;
+        }
+        node->elem_offsets.push_back(end);
+
+        // Later elements are laid out from the same bytes and come out the
+        // same, no matter how many a count read from the data asks for
+        if (end == at) {
+            node->empty_from = idx;
+        }
+    }
+}
+
+qint64 TemplateInstance::elementOffset(Node *node, qint64 idx)
+{
+    if (node->elem_size >= 0)
+        return node->offset + idx * node->elem_size;
+    layoutArray(node, idx, std::numeric_limits<qint64>::max());
+    return node->elem_offsets[std::min<qint64>(idx, node->elem_offsets.size() - 1)];
+}
+
+qint64 TemplateInstance::elementIndexAt(Node *node, qint64 pos)
+{
+    if (node->elem_size > 0)
+        return (pos - node->offset) / node->elem_size;
+    if (node->elem_size == 0)
+        return 0;
+
+    // Only elements already laid out are searched
+    layoutArray(node, 0);
+    auto it = std::upper_bound(node->elem_offsets.begin(), node->elem_offsets.end(), pos);
+    return std::max<qint64>(0, it - node->elem_offsets.begin() - 1);
+}
+
+qint64 TemplateInstance::childCount(Node *node)
+{
+    switch (node->kind) {
+    case Node::Struct:
+        layoutStruct(node);
+        return node->fields.size();
+    case Node::Array:
+        return node->count;
+    default:
+        return 0;
+    }
+}
+
+TemplateInstance::Node *TemplateInstance::child(Node *node, qint64 idx)
+{
+    if (node->kind == Node::Struct) {
+        layoutStruct(node);
+        return node->fields[idx].get();
+    }
+
+    auto &elem = node->elements[idx];
+    if (!elem) {
+        elem = makeElement(node, idx);
+        ++element_count;
+    }
+    return elem.get();
+}
+
+std::unique_ptr<TemplateInstance::Node> TemplateInstance::makeElement(Node *node, qint64 idx)
+{
+    const StructTemplate::Member *member = node->member;
+    auto elem = std::make_unique<Node>(member->type ? Node::Struct : Node::Scalar,
+                                       member, node, idx, elementOffset(node, idx));
+    elem->element = true;
+    if (member->type) {
+        elem->size = member->type->static_size;
+    } else {
+        elem->size = member->scalar_size;
+        elem->has_value = readScalar(*member, elem->offset, elem->value);
+    }
+    return elem;
+}
+
+void TemplateInstance::dropElements(const std::vector<Node*> &keep)
+{
+    std::unordered_set<Node*> pinned;
+    for (Node *node : keep) {
+        for (; node && pinned.insert(node).second; node = node->parent);
+    }
+    element_count = 0;
+    if (root_node) {
+        pruneElements(root_node.get(), pinned);
+    }
+}
+
+void TemplateInstance::pruneElements(Node *node, const std::unordered_set<Node*> &pinned)
+{
+    for (auto &field : node->fields) {
+        pruneElements(field.get(), pinned);
+    }
+    for (auto it = node->elements.begin(); it != node->elements.end();) {
+        if (!pinned.count(it->second.get())) {
+            it = node->elements.erase(it);
+            continue;
+        }
+        ++element_count;
+        pruneElements(it->second.get(), pinned);
+        ++it;
+    }
+}
+
+bool TemplateInstance::hasChildren(Node *node)
+{
+    // Structs are only laid out once expanded
+    if (node->kind == Node::Struct)
+        return !node->type->members.empty();
+    return node->kind == Node::Array && node->count > 0;
+}
+
+QString TemplateInstance::name(Node *node)
+{
+    if (!node->member)
+        return node->type->name;
+    if (node->element)
+        return QString("[%1]").arg(node->row);
+    return node->member->name;
+}
+
+QString TemplateInstance::typeName(Node *node)
+{
+    QString type;
+    if (!node->member) {
+        return node->type->name;
+    } else if (node->member->type) {
+        type = node->member->type->name;
+    } else if (node->member->is_char) {
+        type = "char";
+    } else {
+        type = QString("%1%2%3").arg(node->member->is_signed ? "i" : "u")
+                                .arg(node->member->scalar_size * 8)
+                                .arg(node->member->big_endian ? "be" : "");
+    }
+    if (node->kind == Node::Array) {
+        type += QString("[%1]").arg(node->count);
+    }
+    return type;
+}
+
+QString TemplateInstance::value(Node *node)
+{
+    const StructTemplate::Member *member = node->member;
+    if (node->kind == Node::Scalar) {
+        if (!node->has_value)
+            return QString();
+        if (member->is_char) {
+            QChar c(static_cast<ushort>(node->value & 0xff));
+            return c.isPrint() ? QString("'%1'").arg(c) : QString("0x%1").arg(node->value & 0xff, 2, 16, QChar('0'));
+        }
+        return member->is_signed ? QString::number(node->value)
+                                 : QString::number(static_cast<quint64>(node->value));
+    }
+
+    // Byte arrays are shown inline, decoding them element by element is pointless
+    if (node->kind == Node::Array && !member->type && member->scalar_size == 1) {
+        qint64 len = std::min<qint64>(node->count, MAX_PREVIEW);
+        QByteArray bytes(len, 0);
+        len = document->read(node->offset, bytes.data(), len);
+        bytes.truncate(len);
+        QString text = member->is_char ? QString("\"%1\"").arg(QString::fromLatin1(bytes))
+                                       : QString(bytes.toHex(' '));
+        return node->count > len ? text + "..." : text;
+    }
+    return QString();
+}
+
+qint64 TemplateInstance::offset(Node *node)
+{
+    return node->offset;
+}
+
+qint64 TemplateInstance::size(Node *node)
+{
+    if (node->kind != Node::Scalar) {
+        layoutUntil(node, std::numeric_limits<qint64>::max());
+    }
+    return node->size;
+}
+
+TemplateInstance::Node *TemplateInstance::parent(Node *node)
+{
+    return node->parent;
+}
+
+qint64 TemplateInstance::row(Node *node)
+{
+    return node->row;
+}
+
+void TemplateInstance::collectFields(Node *node, qint64 begin, qint64 end, int depth,
+                                     Placements &placed, std::vector<FieldSpan> &out)
+{
+    if (depth > MAX_DEPTH)
+        return;
+
+    const StructTemplate::Member *member = node->member;
+    switch (node->kind) {
+    case Node::Scalar:
+        if (node->offset < end && node->offset + node->size > begin) {
+            out.push_back({ node->offset, node->offset + node->size });
+        }
+        break;
+    case Node::Struct:
+        layoutStruct(node, end);
+        for (auto &field : node->fields) {
+            if (field->offset >= end)
+                continue;
+            if (field->size >= 0 && field->offset + field->size <= begin)
+                continue;
+            // Pointers back into the data already collected decode to the
+            // same fields, following them again only goes round in circles
+            if (field->member->at && !placed.insert({ field->member, field->offset }).second)
+                continue;
+            collectFields(field.get(), begin, end, depth + 1, placed, out);
+        }
+        break;
+    case Node::Array: {
+        if (node->count == 0)
+            break;
+        // Strings and byte arrays are a single field
+        if (!member->type && member->scalar_size == 1) {
+            if (node->offset < end && node->offset + node->count > begin) {
+                out.push_back({ node->offset, node->offset + node->count });
+            }
+            break;
+        }
+        if (node->offset >= end)
+            break;
+        // Elements taking no space are all the same, one of them will do
+        qint64 first = elementIndexAt(node, std::max(begin, node->offset));
+        qint64 last = node->elem_size == 0 ? std::min<qint64>(node->count, 1) : node->count;
+        for (qint64 idx = first; idx < last; ++idx) {
+            if (elementOffset(node, idx) >= end)
+                break;
+            if (node->empty_from >= 0 && idx > node->empty_from)
+                break;
+            if (node->elem_size < 0 && elementOffset(node, idx + 1) <= begin)
+                continue;
+            // Elements the tree doesn't keep are decoded for this call only
+            auto kept = node->elements.find(idx);
+            if (kept != node->elements.end()) {
+                collectFields(kept->second.get(), begin, end, depth + 1, placed, out);
+            } else {
+                collectFields(makeElement(node, idx).get(), begin, end, depth + 1, placed, out);
+            }
+        }
+        break;
+    }
+    }
+}
+
+std::vector<TemplateInstance::FieldSpan> TemplateInstance::fieldsIn(qint64 begin, qint64 end)
+{
+    std::vector<FieldSpan> out;
+    Placements placed;
+    collectFields(root(), begin, end, 0, placed, out);
+    std::sort(out.begin(), out.end(),
+        [](const FieldSpan &a, const FieldSpan &b) { return a.begin < b.begin; });
+    return out;
+}
@@ -0,0 +1,185 @@
+/*
+ * HexEditor -- Qt based hex editor
+ * Copyright (C) 2021  Mate Kukri
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef STRUCTTEMPLATE_H
+#define STRUCTTEMPLATE_H
+
+#include <QString>
+#include <QStringList>
+#include <functional>
+#include <limits>
+#include <map>
+#include <memory>
+#include <set>
+#include <unordered_set>
+#include <vector>
+#include "document.h"
+
+//
+// Declarative description of binary structures
+//
+// A template is a list of structs, members are laid out back to back:
+//
+//   struct Header {
+//       char[4]     magic;
+//       u32         count;
+//       u64be       table_offset;
+//       if (count > 0) {
+//           Entry[count]    entries;
+//       }
+//       Entry[count] @ table_offset     table;
+//   }
+//
+// Scalar types are u8 to u64 and i8 to i64, little endian unless suffixed
+// with "be", and char. A member is an array if followed by a count in
+// brackets, is placed at an offset from the start of the outermost struct
+// instead of inline if followed by "@ expr", and only exists if the
+// conditions of the if statements around it hold. Expressions use C operators
+// on integer literals and the scalar members before them, including those
+// of enclosing structs.
+//
+class StructTemplate
+{
+public:
+    struct Expr;
+    struct StructDef;
+
+    struct Member {
+        QString name;
+        // Scalar members
+        int scalar_size;
+        bool is_signed;
+        bool big_endian;
+        bool is_char;
+        // Struct members, nullptr for scalars
+        QString type_name;
+        const StructDef *type;
+        std::shared_ptr<Expr> count;
+        std::shared_ptr<Expr> at;
+        std::shared_ptr<Expr> condition;
+    };
+
+    struct StructDef {
+        QString name;
+        std::vector<Member> members;
+        // Size in bytes if it doesn't depend on the data, -1 otherwise
+        qint64 static_size;
+    };
+
+    // Parse text, throws a QString describing the first error
+    explicit StructTemplate(QString text);
+
+    QStringList structNames();
+    const StructDef *findStruct(QString name);
+
+    // Evaluate expr, looking up names with lookup
+    static bool evaluate(const Expr &expr, const std::function<bool(const QString &, qint64 &)> &lookup,
+                         qint64 &result);
+
+private:
+    std::vector<std::unique_ptr<StructDef>> structs;
+
+    qint64 staticSize(StructDef *def, std::vector<StructDef*> &stack);
+};
+
+//
+// A struct template applied at an offset of a document
+//
+// Nothing is decoded up front. A struct is laid out the first time one of
+// its members is asked for, array elements of a fixed size are located by
+// multiplication, so a template over a huge array only ever decodes the
+// elements that are looked at. Variable sized elements are laid out one
+// after the other only as far as they are looked at, or as far as needed to
+// place the members after them. Nodes asked for by child() are kept until
+// the document is edited or dropElements() lets them go, fieldsIn() keeps
+// none of the array elements it decodes.
+//
+class TemplateInstance
+{
+public:
+    struct Node;
+
+    // Leaf field covering [begin, end)
+    struct FieldSpan {
+        qint64 begin, end;
+    };
+
+    TemplateInstance(std::shared_ptr<Document> document,
+                     std::shared_ptr<StructTemplate> structs,
+                     const StructTemplate::StructDef *root_type, qint64 offset);
+    ~TemplateInstance();
+
+    Node *root();
+
+    // Drop everything decoded, the document changed
+    void invalidate();
+
+    // Number of children of node, lays node out if needed
+    qint64 childCount(Node *node);
+    Node *child(Node *node, qint64 idx);
+    bool hasChildren(Node *node);
+
+    // Display strings of node
+    QString name(Node *node);
+    QString typeName(Node *node);
+    QString value(Node *node);
+    qint64 offset(Node *node);
+    qint64 size(Node *node);
+    Node *parent(Node *node);
+    qint64 row(Node *node);
+
+    // Leaf fields overlapping [begin, end) in offset order
+    std::vector<FieldSpan> fieldsIn(qint64 begin, qint64 end);
+
+    // Number of array elements kept by child()
+    qint64 cachedElements() { return element_count; }
+
+    // Forget kept array elements, except those in keep and their ancestors
+    void dropElements(const std::vector<Node*> &keep);
+
+private:
+    std::shared_ptr<Document> document;
+    std::shared_ptr<StructTemplate> structs;
+    const StructTemplate::StructDef *root_type;
+    qint64 base;
+    std::unique_ptr<Node> root_node;
+    qint64 element_count;
+
+    // Lay out the members of a struct, or the elements of an array up to
+    // up_to, stopping before anything inline that would start at or past until
+    void layoutStruct(Node *node, qint64 until = std::numeric_limits<qint64>::max());
+    void layoutArray(Node *node, qint64 up_to, qint64 until = std::numeric_limits<qint64>::max());
+
+    // Find the extent of a variable sized node if it ends before until,
+    // returns false if it reaches past until
+    bool layoutUntil(Node *node, qint64 until);
+    bool resolveOpenField(Node *node, qint64 until);
+    qint64 elementOffset(Node *node, qint64 idx);
+    qint64 elementIndexAt(Node *node, qint64 pos);
+    bool readScalar(const StructTemplate::Member &member, qint64 offset, qint64 &value);
+    bool lookup(Node *node, const QString &name, qint64 &value);
+    std::unique_ptr<Node> makeElement(Node *node, qint64 idx);
+    void pruneElements(Node *node, const std::unordered_set<Node*> &pinned);
+
+    // Placements of pointed to members already collected
+    typedef std::set<std::pair<const StructTemplate::Member*, qint64>> Placements;
+    void collectFields(Node *node, qint64 begin, qint64 end, int depth,
+                       Placements &placed, std::vector<FieldSpan> &out);
+};
+
+#endif // STRUCTTEMPLATE_H
@@ -0,0 +1,129 @@
+/*
+ * HexEditor -- Qt based hex editor
+ * Copyright (C) 2021  Mate Kukri
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "transformdialog.h"
+#include "finddialog.h"
+#include <QMessageBox>
+
+// Longest key accepted for XOR, add and subtract
+static int MAX_KEY = 256;
+
+TransformDialog::TransformDialog(QWidget *parent) :
+    QDialog(parent),
+    operation_box(this),
+    operation_combo_box_label("Operation:", &operation_box),
+    operation_combo_box(&operation_box),
+    operand_box(this),
+    operand_line_edit_label(&operand_box),
+    operand_line_edit(&operand_box),
+    button_box(QDialogButtonBox::StandardButton::Ok
+               | QDialogButtonBox::StandardButton::Cancel, this)
+{
+    // Setup operation box
+    operation_combo_box.addItem("XOR with key", Transform::Xor);
+    operation_combo_box.addItem("Add key", Transform::Add);
+    operation_combo_box.addItem("Subtract key", Transform::Subtract);
+    operation_combo_box.addItem("Rotate bits left", Transform::RotateLeft);
+    operation_combo_box.addItem("Rotate bits right", Transform::RotateRight);
+    operation_combo_box.addItem("Swap bytes of 16-bit words", Transform::Swap16);
+    operation_combo_box.addItem("Swap bytes of 32-bit words", Transform::Swap32);
+    operation_combo_box.addItem("Swap bytes of 64-bit words", Transform::Swap64);
+    operation_box_layout.addWidget(&operation_combo_box_label);
+    operation_box_layout.addWidget(&operation_combo_box);
+    operation_box.setLayout(&operation_box_layout);
+
+    // Setup operand box
+    operand_box_layout.addWidget(&operand_line_edit_label);
+    operand_box_layout.addWidget(&operand_line_edit);
+    operand_box.setLayout(&operand_box_layout);
+
+    // Setup main UI
+    layout.addWidget(&operation_box);
+    layout.addWidget(&operand_box);
+    layout.addStretch();
+    layout.addWidget(&button_box);
+    setLayout(&layout);
+    setWindowTitle(tr("Transform Selection"));
+    resize(400, 130);
+    handleOperationChanged();
+
+    // Connect event handlers
+    QObject::connect(&operation_combo_box, SIGNAL(currentIndexChanged(int)), this, SLOT(handleOperationChanged()));
+    QObject::connect(&button_box, SIGNAL(rejected()), this, SLOT(reject()));
+    QObject::connect(&button_box, SIGNAL(accepted()), this, SLOT(validateThenAccept()));
+}
+
+Transform TransformDialog::getTransform()
+{
+    return transform;
+}
+
+void TransformDialog::handleOperationChanged()
+{
+    auto kind = static_cast<Transform::Kind>(operation_combo_box.currentData().toInt());
+    switch (kind) {
+    case Transform::Xor:
+    case Transform::Add:
+    case Transform::Subtract:
+        operand_line_edit_label.setText("Key (hex):");
+        operand_box.setEnabled(true);
+        break;
+    case Transform::RotateLeft:
+    case Transform::RotateRight:
+        operand_line_edit_label.setText("Bits:");
+        operand_box.setEnabled(true);
+        break;
+    default:
+        operand_line_edit_label.setText("Operand:");
+        operand_box.setEnabled(false);
+        break;
+    }
+}
+
+void TransformDialog::validateThenAccept()
+{
+    transform.kind = static_cast<Transform::Kind>(operation_combo_box.currentData().toInt());
+    transform.key = QByteArray();
+    transform.bits = 0;
+
+    bool valid = true;
+    switch (transform.kind) {
+    case Transform::Xor:
+    case Transform::Add:
+    case Transform::Subtract:
+        transform.key = FindDialog::parsePattern(operand_line_edit.text(), true);
+        valid = !transform.key.isEmpty() && transform.key.size() <= MAX_KEY;
+        break;
+    case Transform::RotateLeft:
+    case Transform::RotateRight:
+        transform.bits = operand_line_edit.text().toInt(&valid);
+        valid = valid && transform.bits >= 1 && transform.bits <= 7;
+        break;
+    default:
+        break;
+    }
+
+    if (valid) {
+        accept();
+    } else {
+        QMessageBox msgBox(this);
+        msgBox.setText("Invalid operand!");
+        msgBox.setIcon(QMessageBox::Icon::Critical);
+        msgBox.exec();
+    }
+}
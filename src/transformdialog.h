@@ -0,0 +1,60 @@
+/*
+ * HexEditor -- Qt based hex editor
+ * Copyright (C) 2021  Mate Kukri
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef TRANSFORMDIALOG_H
+#define TRANSFORMDIALOG_H
+
+#include <QComboBox>
+#include <QDialog>
+#include <QDialogButtonBox>
+#include <QLineEdit>
+#include <QHBoxLayout>
+#include <QVBoxLayout>
+#include <QLabel>
+#include "transformsource.h"
+
+class TransformDialog : public QDialog
+{
+    Q_OBJECT
+
+public:
+    explicit TransformDialog(QWidget *parent = nullptr);
+    Transform getTransform();
+
+private:
+    // UI
+    QWidget operation_box;
+    QLabel operation_combo_box_label;
+    QComboBox operation_combo_box;
+    QHBoxLayout operation_box_layout;
+    QWidget operand_box;
+    QLabel operand_line_edit_label;
+    QLineEdit operand_line_edit;
+    QHBoxLayout operand_box_layout;
+    QDialogButtonBox button_box;
+    QVBoxLayout layout;
+
+    // Saved values
+    Transform transform;
+
+private slots:
+    void handleOperationChanged();
+    void validateThenAccept();
+};
+
+#endif // TRANSFORMDIALOG_H
@@ -0,0 +1,230 @@
+/*
+ * HexEditor -- Qt based hex editor
+ * Copyright (C) 2021  Mate Kukri
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "transformsource.h"
+#include <algorithm>
+#include <cstring>
+#include <unordered_set>
+#include <vector>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// XOR, add or subtract the key repeated from pos
+template<Transform::Kind KIND>
+static void applyKey(const QByteArray &key, qint64 pos, unsigned char *data, qint64 len)
+{
+    if (key.isEmpty())
+        return;
+
+    // Key starting at pos over a whole number of keys and vectors, so the
+    // loops below only ever wrap around to its start
+    std::vector<unsigned char> pattern(16 * key.size());
+    for (size_t i = 0; i < pattern.size(); ++i) {
+        pattern[i] = static_cast<unsigned char>(key.at((pos + i) % key.size()));
+    }
+
+    qint64 i = 0;
+#ifdef __SSE2__
+    size_t at = 0;
+    for (; i + 16 <= len; i += 16) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+        __m128i k = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pattern.data() + at));
+        if constexpr (KIND == Transform::Xor) {
+            v = _mm_xor_si128(v, k);
+        } else if constexpr (KIND == Transform::Add) {
+            v = _mm_add_epi8(v, k);
+        } else {
+            v = _mm_sub_epi8(v, k);
+        }
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(data + i), v);
+        at += 16;
+        if (at == pattern.size()) {
+            at = 0;
+        }
+    }
+#endif
+    for (; i < len; ++i) {
+        unsigned char k = pattern[i % pattern.size()];
+        if constexpr (KIND == Transform::Xor) {
+            data[i] ^= k;
+        } else if constexpr (KIND == Transform::Add) {
+            data[i] += k;
+        } else {
+            data[i] -= k;
+        }
+    }
+}
+
+// Rotate every byte left by bits
+static void rotateBytes(int bits, unsigned char *data, qint64 len)
+{
+    bits &= 7;
+    if (bits == 0)
+        return;
+
+    qint64 i = 0;
+#ifdef __SSE2__
+    // There are no byte shifts, shift words and drop the bits that crossed
+    // into the neighbouring byte
+    const __m128i left = _mm_cvtsi32_si128(bits);
+    const __m128i right = _mm_cvtsi32_si128(8 - bits);
+    const __m128i left_mask = _mm_set1_epi8(static_cast<char>(0xff << bits));
+    const __m128i right_mask = _mm_set1_epi8(static_cast<char>(0xff >> (8 - bits)));
+    for (; i + 16 <= len; i += 16) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+        v = _mm_or_si128(_mm_and_si128(_mm_sll_epi16(v, left), left_mask),
+                         _mm_and_si128(_mm_srl_epi16(v, right), right_mask));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(data + i), v);
+    }
+#endif
+    for (; i < len; ++i) {
+        data[i] = static_cast<unsigned char>((data[i] << bits) | (data[i] >> (8 - bits)));
+    }
+}
+
+// Reverse the bytes of every word of data, len is a multiple of word
+static void swapWords(int word, unsigned char *data, qint64 len)
+{
+    qint64 i = 0;
+#ifdef __SSE2__
+    // Swap the bytes of every 16-bit word, then reorder the words
+    for (; i + 16 <= len; i += 16) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+        v = _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8));
+        if (word == 4) {
+            v = _mm_shufflelo_epi16(v, _MM_SHUFFLE(2, 3, 0, 1));
+            v = _mm_shufflehi_epi16(v, _MM_SHUFFLE(2, 3, 0, 1));
+        } else if (word == 8) {
+            v = _mm_shufflelo_epi16(v, _MM_SHUFFLE(0, 1, 2, 3));
+            v = _mm_shufflehi_epi16(v, _MM_SHUFFLE(0, 1, 2, 3));
+        }
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(data + i), v);
+    }
+#endif
+    for (; i < len; i += word) {
+        std::reverse(data + i, data + i + word);
+    }
+}
+
+int Transform::wordSize() const
+{
+    switch (kind) {
+    case Swap16: return 2;
+    case Swap32: return 4;
+    case Swap64: return 8;
+    default:     return 1;
+    }
+}
+
+void Transform::apply(qint64 pos, char *data, qint64 len) const
+{
+    auto bytes = reinterpret_cast<unsigned char*>(data);
+    switch (kind) {
+    case Xor:
+        applyKey<Xor>(key, pos, bytes, len);
+        break;
+    case Add:
+        applyKey<Add>(key, pos, bytes, len);
+        break;
+    case Subtract:
+        applyKey<Subtract>(key, pos, bytes, len);
+        break;
+    case RotateLeft:
+        rotateBytes(bits, bytes, len);
+        break;
+    case RotateRight:
+        rotateBytes(8 - (bits & 7), bytes, len);
+        break;
+    case Swap16:
+    case Swap32:
+    case Swap64:
+        swapWords(wordSize(), bytes, len / wordSize() * wordSize());
+        break;
+    }
+}
+
+TransformByteSource::TransformByteSource(PieceTable input, Transform transform)
+    : input(input),
+      transform(transform),
+      is_volatile(false)
+{
+    std::unordered_set<ByteSource*> seen;
+    bool many_files = false;
+    this->input.forEach(0, this->input.size(), [&](qint64, const Piece &piece) {
+        ByteSource *source = piece.source.get();
+        if (!seen.insert(source).second)
+            return true;
+
+        sources.push_back(source);
+        is_volatile = is_volatile || source->isVolatile();
+        QString name = source->fileName();
+        if (!name.isEmpty() && !file_name.isEmpty() && name != file_name) {
+            many_files = true;
+        } else if (!name.isEmpty()) {
+            file_name = name;
+        }
+        return true;
+    });
+    if (many_files) {
+        file_name.clear();
+    }
+}
+
+bool TransformByteSource::fileReplaced()
+{
+    for (ByteSource *source : sources) {
+        if (source->fileReplaced())
+            return true;
+    }
+    return false;
+}
+
+qint64 TransformByteSource::size()
+{
+    return input.size();
+}
+
+qint64 TransformByteSource::read(qint64 offset, char *buf, qint64 len)
+{
+    if (offset < 0 || offset >= input.size())
+        return 0;
+    len = std::min(len, input.size() - offset);
+
+    // Word transforms need the whole words around the bytes asked for
+    qint64 word = transform.wordSize();
+    qint64 begin = offset / word * word;
+    qint64 end = std::min((offset + len + word - 1) / word * word, input.size());
+    if (begin == offset && end == offset + len) {
+        qint64 got = input.read(offset, buf, len);
+        transform.apply(offset, buf, got);
+        return got;
+    }
+
+    std::vector<char> words(end - begin);
+    qint64 got = input.read(begin, words.data(), end - begin);
+    transform.apply(begin, words.data(), got);
+    qint64 cnt = std::max<qint64>(0, std::min(got - (offset - begin), len));
+    memcpy(buf, words.data() + (offset - begin), cnt);
+    return cnt;
+}
+
+QVector<ByteRange> TransformByteSource::mappedRanges(qint64 begin, qint64 end)
+{
+    return input.mappedRanges(begin, end);
+}
@@ -0,0 +1,92 @@
+/*
+ * HexEditor -- Qt based hex editor
+ * Copyright (C) 2021  Mate Kukri
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef TRANSFORMSOURCE_H
+#define TRANSFORMSOURCE_H
+
+#include "document.h"
+
+//
+// Reversible operation applied to every byte or word of a range
+//
+struct Transform
+{
+    enum Kind {
+        Xor,
+        Add,
+        Subtract,
+        RotateLeft,
+        RotateRight,
+        Swap16,
+        Swap32,
+        Swap64,
+    };
+
+    Kind kind;
+    // Operand of Xor, Add and Subtract, repeated from the start of the range
+    QByteArray key;
+    // Number of bits each byte is rotated by
+    int bits;
+
+    // Bytes the transform works on at once, a short last word is left alone
+    int wordSize() const;
+
+    // Transform len bytes at pos of the range held in data
+    void apply(qint64 pos, char *data, qint64 len) const;
+};
+
+//
+// Transformed view of part of a document
+//
+// Nothing is transformed up front, every read transforms the bytes it
+// returns, so a transform of any size is applied instantly and shares the
+// bytes it was applied to with the undo history. Everything that depends
+// on the sources the bytes come from is answered for the sources of the
+// input, nested transforms included. The view holds no memory itself, the
+// sources it reads from are counted wherever they are reachable.
+//
+class TransformByteSource : public ByteSource
+{
+    Q_OBJECT
+
+public:
+    TransformByteSource(PieceTable input, Transform transform);
+
+    using ByteSource::read;
+    qint64 size() override;
+    qint64 read(qint64 offset, char *buf, qint64 len) override;
+    QVector<ByteRange> mappedRanges(qint64 begin, qint64 end) override;
+
+    // The file every file backed piece of the input comes from, empty if
+    // they come from more than one
+    QString fileName() override { return file_name; }
+    bool isVolatile() override { return is_volatile; }
+    bool fileReplaced() override;
+    std::vector<ByteSource*> innerSources() override { return sources; }
+
+private:
+    const PieceTable input;
+    const Transform transform;
+
+    // Distinct sources of the input, which never changes
+    std::vector<ByteSource*> sources;
+    QString file_name;
+    bool is_volatile;
+};
+
+#endif // TRANSFORMSOURCE_H